@@ -237,9 +237,20 @@ end
 
 
 ------------
+-- the optional 6th argument limits each call of the command,
+-- e.g. {timeout = 200, instructions = 1000000}, timeout in milliseconds.
+-- commands whose results only depend on the argument may add pure = true,
+-- then the results of recent arguments are cached.
+-- commands with many results may return them lazily, as an iterator
+-- function, a coroutine or a (count, fetch(i)) pair, then only the
+-- shown pages are pulled.
 ime.register_command("sj", "get_time", "输入时间", "alpha", "输入可选时间，例如12:34")
 ime.register_command("rq", "get_date", "输入日期", "alpha", "输入可选日期，例如2013-01-01")
 ime.register_command("js", "compute", "计算模式", "none", "输入表达式，例如log(2)")
-ime.register_command("xz", "query_zodiac", "查询星座", "none", "输入您的生日，例如12-3")
+ime.register_command("xz", "query_zodiac", "查询星座", "none", "输入您的生日，例如12-3", {pure = true})
+
+-- triggers are called with the input after "i" when it contains one of
+-- the input trigger strings, e.g.
+-- ime.register_trigger("get_date", "输入日期", {"riqi"}, {"日期"})
 
 print("lua script loaded.")
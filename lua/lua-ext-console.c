@@ -53,16 +53,24 @@ void list_all_commands(IBusEnginePlugin * plugin){
 }
 
 int print_lua_call_result(IBusEnginePlugin * plugin, size_t num){
+  lua_command_candidates_t * results;
+  size_t i;
+
+  if ( 0 == num )
+    return 0;
+
+  results = ibus_engine_plugin_get_candidates(plugin);
+  if ( NULL == results )
+    return 0;
+
   if ( 1 == num ) {
-    const lua_command_candidate_t * result = ibus_engine_plugin_get_retval(plugin);
+    const lua_command_candidate_t * result = &results->candidates[0];
     if (result->content)
       printf("result: %s.\n", result->content);
   }
   if ( num > 1) {
-    GArray * results = ibus_engine_plugin_get_retvals(plugin);
-    size_t i;
     for ( i = 0; i < results->len; ++i) {
-      const lua_command_candidate_t * result = g_array_index(results, const lua_command_candidate_t *, i);
+      const lua_command_candidate_t * result = &results->candidates[i];
       if (result->content)
           printf("%d.%s >\t", (int)i, result->content);
       else{
@@ -71,12 +79,14 @@ int print_lua_call_result(IBusEnginePlugin * plugin, size_t num){
     }
     printf("\n");
   }
+
+  ibus_engine_plugin_candidates_unref(results);
   return 0;
 }
 
 int do_lua_call(IBusEnginePlugin * plugin, const char * command_name, const char * argument){
   const lua_command_t * command;
-  size_t num;
+  int num;
 
   g_return_val_if_fail(2 == strlen(command_name), 2);
   command = ibus_engine_plugin_lookup_command(plugin, command_name);
@@ -85,7 +95,11 @@ int do_lua_call(IBusEnginePlugin * plugin, const char * command_name, const char
     return 1;
   }
 
-  num = ibus_engine_plugin_call(plugin, command->lua_function_name, argument);
+  num = ibus_engine_plugin_call_command(plugin, command, argument);
+  if ( LUA_PLUGIN_CALL_TIMED_OUT == num ){
+    fprintf(stderr, "command %s timed out.\n", command_name);
+    return 1;
+  }
   print_lua_call_result(plugin, num);
   return 0;
 }
@@ -216,16 +216,28 @@ static int ime_register_command(lua_State * L){
 
   new_command.description = luaL_checklstring(L, 3, NULL);
 
-  if ( !lua_isnone(L, 4)) {
+  if ( !lua_isnoneornil(L, 4)) {
     new_command.leading = luaL_checklstring(L, 4, NULL);
   }else{
     new_command.leading = "digit";
   }
 
-  if ( !lua_isnone(L, 5)) {
+  if ( !lua_isnoneornil(L, 5)) {
     new_command.help = luaL_checklstring(L, 5, NULL);
   }
 
+  /* optional options, as {instructions = n, timeout = ms, pure = true}. */
+  if ( !lua_isnoneornil(L, 6)) {
+    luaL_checktype(L, 6, LUA_TTABLE);
+    lua_getfield(L, 6, "instructions");
+    new_command.instructions = lua_tointeger(L, -1);
+    lua_getfield(L, 6, "timeout");
+    new_command.timeout = lua_tointeger(L, -1);
+    lua_getfield(L, 6, "pure");
+    new_command.pure = lua_toboolean(L, -1);
+    lua_pop(L, 3);
+  }
+
   gboolean result = ibus_engine_plugin_add_command
     (lua_plugin_retrieve_plugin(L), &new_command);
 
@@ -235,34 +247,63 @@ static int ime_register_command(lua_State * L){
   return 0;
 }
 
-static int ime_register_trigger(lua_State * L){
-  const char * lua_function_name = luaL_checklstring(L, 1, NULL);
-  const char * description = luaL_checklstring(L, 2, NULL);
+/* the strings of the table at index, as a NULL terminated array of copies. */
+static char ** ime_check_string_array(lua_State * L, int index){
   size_t num; size_t i;
-  fprintf(stderr, "TODO: ime_register_trigger unimplemented when called with %s (%s).\n", lua_function_name, description);
+  char ** strings;
 
-  luaL_checktype(L, 3, LUA_TTABLE);
+  luaL_checktype(L, index, LUA_TTABLE);
 
-  /* TODO: register_trigger with input_trigger_strings. */
-  num = lua_objlen(L, 3);
+  num = lua_objlen(L, index);
+  strings = g_new0(char *, num + 1);
   for ( i = 0; i < num; ++i) {
     lua_pushinteger(L, i + 1);
-    lua_gettable(L, 3);
-    fprintf(stderr, "%d:%s\t", (int)i + 1, lua_tostring(L, -1));
+    lua_gettable(L, index);
+    if ( !lua_isstring(L, -1) ){
+      lua_pop(L, 1);
+      g_strfreev(strings);
+      return NULL;
+    }
+    strings[i] = g_strdup(lua_tostring(L, -1));
     lua_pop(L, 1);
   }
-  fprintf(stderr, "\n");
+  return strings;
+}
 
-  luaL_checktype(L, 4, LUA_TTABLE);
+static int ime_register_trigger(lua_State * L){
+  lua_trigger_t new_trigger;
+  char ** input_strings, ** candidate_strings;
+  gboolean result;
 
-  /* TODO: register_trigger with candidate_trigger_strings. */
-  num = lua_objlen(L, 4);
-  for ( i = 0; i < num; ++i) {
-    lua_pushinteger(L, i + 1);
-    lua_gettable(L, 4);
-    fprintf(stderr, "%d:%s\t", (int) i + 1, lua_tostring(L, -1));
+  memset(&new_trigger, 0, sizeof(new_trigger));
+  new_trigger.lua_function_name = luaL_checklstring(L, 1, NULL);
+  lua_getglobal(L, new_trigger.lua_function_name);
+  luaL_checktype(L, -1, LUA_TFUNCTION);
+  lua_pop(L, 1);
+
+  new_trigger.description = luaL_checklstring(L, 2, NULL);
+
+  input_strings = ime_check_string_array(L, 3);
+  if ( NULL == input_strings )
+    return luaL_error(L, "register trigger %s with non-string input trigger strings.\n", new_trigger.lua_function_name);
+
+  candidate_strings = ime_check_string_array(L, 4);
+  if ( NULL == candidate_strings ){
+    g_strfreev(input_strings);
+    return luaL_error(L, "register trigger %s with non-string candidate trigger strings.\n", new_trigger.lua_function_name);
   }
-  fprintf(stderr, "\n");
+
+  new_trigger.input_trigger_strings = (const char * const *) input_strings;
+  new_trigger.candidate_trigger_strings = (const char * const *) candidate_strings;
+
+  result = ibus_engine_plugin_add_trigger
+    (lua_plugin_retrieve_plugin(L), &new_trigger);
+
+  g_strfreev(input_strings);
+  g_strfreev(candidate_strings);
+
+  if (!result)
+    return luaL_error(L, "register trigger with function %s failed.\n", new_trigger.lua_function_name);
 
   return 0;
 }
@@ -410,7 +451,6 @@ static const luaL_Reg imelib[] = {
   {"register_command", ime_register_command},
   /* Note: the register_converter function is dropped for ibus-libpinyin. */
   {"register_converter", ime_register_converter},
-  /* Note: the register_trigger function is dropped for ibus-libpinyin. */
   {"register_trigger", ime_register_trigger},
   {"split_string", ime_split_string},
   {"trim_string_left", ime_trim_string_left},
@@ -36,13 +36,103 @@
 
 #endif
 
+/* resume the coroutine co from L without arguments. */
+#if LUA_VERSION_NUM >= 504
+static int lua_plugin_resume(lua_State * co, lua_State * L){
+  int nres;
+  return lua_resume(co, L, 0, &nres);
+}
+#elif LUA_VERSION_NUM >= 502
+#define lua_plugin_resume(co, L) lua_resume(co, L, 0)
+#else
+#define lua_plugin_resume(co, L) lua_resume(co, 0)
+#endif
+
+/* the budget hook runs every LUA_PLUGIN_HOOK_COUNT instructions. */
+#define LUA_PLUGIN_HOOK_COUNT 1000
+#define LUA_PLUGIN_DEFAULT_INSTRUCTIONS 10000000
+#define LUA_PLUGIN_DEFAULT_TIMEOUT 100 /* ms */
+/* commands are demoted after this number of timeouts. */
+#define LUA_PLUGIN_MAX_TIMEOUTS 3
+/* number of cached results of pure commands. */
+#define LUA_PLUGIN_RESULT_CACHE_SIZE 64
+/* number of items pulled from a lazy result by the call itself. */
+#define LUA_PLUGIN_GENERATOR_PREFETCH 20
+
+/* an output of a matcher state, in a list linked by next. */
+typedef struct _lua_trigger_output_t{
+  guint trigger; /* index in lua_triggers. */
+  guint next; /* index + 1 in output_nodes, or 0. */
+} lua_trigger_output_t;
+
+/* Aho-Corasick automaton over the trigger strings of one kind. */
+typedef struct _lua_trigger_matcher_t{
+  GPtrArray * strings; /* trigger strings. */
+  GArray * string_triggers; /* index in lua_triggers of each string. */
+  gboolean dirty; /* the automaton is not built from strings yet. */
+  /* state * 256 + byte => next state, state 0 is the root. */
+  guint * next;
+  /* state => index + 1 in output_nodes, or 0. */
+  guint * outputs;
+  GArray * output_nodes; /* Array of lua_trigger_output_t. */
+} lua_trigger_matcher_t;
+
 #define IBUS_ENGINE_PLUGIN_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), IBUS_TYPE_ENGINE_PLUGIN, IBusEnginePluginPrivate))
 
 struct _IBusEnginePluginPrivate{
   lua_State * L;
   GArray * lua_commands; /* Array of lua_command_t. */
+  GHashTable * command_index; /* command_name => index + 1 in lua_commands. */
+  gboolean commands_dirty; /* lua_commands is not sorted yet. */
+  /* sorted commands with the same first byte are consecutive. */
+  guint prefix_start[256];
+  guint prefix_count[256];
+  GArray * lua_triggers; /* Array of lua_command_t, without command index. */
+  lua_trigger_matcher_t trigger_matchers[LUA_TRIGGER_LAST];
+  /* budget of the running call. */
+  long call_instructions; /* instructions left. */
+  gint64 call_deadline; /* monotonic time, in microseconds. */
+  gboolean call_timed_out;
+  GCancellable * call_cancellable;
+  /* runs the asynchronous calls, with at most one thread. */
+  GThreadPool * call_pool;
+  /* held by the worker thread while it uses the lua state. */
+  GMutex call_lock;
+  /* the worker thread runs a call, the commands and triggers are
+     read by the main thread meanwhile, so they can't be registered. */
+  gboolean worker_call;
+  /* results of pure commands, most recently used first. */
+  GMutex cache_lock;
+  GHashTable * result_cache; /* command_name + argument => link in result_lru. */
+  GQueue result_lru; /* queue of lua_cached_result_t. */
+  /* the lazy result of the last call which returned one. */
+  int generator_ref; /* reference in the lua registry, or LUA_NOREF. */
+  int generator_serial;
+  gboolean generator_pending; /* the retval of the last call is its items. */
+  gboolean generator_more;
 };
 
+typedef struct _lua_cached_result_t{
+  char * key;
+  lua_command_candidates_t * candidates;
+} lua_cached_result_t;
+
+/* an asynchronous command call, or a fetch of lazy results when previous is set. */
+typedef struct _lua_call_data_t{
+  lua_command_t * command;
+  char * argument;
+  int result;
+  lua_command_candidates_t * candidates;
+  lua_command_candidates_t * previous;
+  guint len;
+} lua_call_data_t;
+
+/* the strings of some candidates, the fetched candidates keep the previous ones. */
+typedef struct _lua_candidate_strings_t{
+  int ref_count;
+  struct _lua_candidate_strings_t * previous;
+} lua_candidate_strings_t;
+
 G_DEFINE_TYPE (IBusEnginePlugin, ibus_engine_plugin, G_TYPE_OBJECT);
 
 static void lua_command_clone(lua_command_t * command, lua_command_t * new_command){
@@ -51,6 +141,10 @@ static void lua_command_clone(lua_command_t * command, lua_command_t * new_comma
   new_command->description = g_strdup(command->description);
   new_command->leading = g_strdup(command->leading);
   new_command->help = g_strdup(command->help);
+  new_command->instructions = command->instructions;
+  new_command->timeout = command->timeout;
+  new_command->pure = command->pure;
+  new_command->timeouts = 0;
 }
 
 static void lua_command_reclaim(lua_command_t * command){
@@ -63,6 +157,9 @@ static void lua_command_reclaim(lua_command_t * command){
 
 static int
 lua_plugin_init(IBusEnginePluginPrivate * plugin){
+  lua_trigger_matcher_t * matcher;
+  int i;
+
   g_assert(NULL == plugin->L);
   /* initialize Lua */
   plugin->L = lua_open();
@@ -72,6 +169,20 @@ lua_plugin_init(IBusEnginePluginPrivate * plugin){
 
   g_assert ( NULL == plugin->lua_commands );
   plugin->lua_commands = g_array_new(TRUE, TRUE, sizeof(lua_command_t));
+  plugin->command_index = g_hash_table_new(g_str_hash, g_str_equal);
+  plugin->commands_dirty = FALSE;
+  plugin->lua_triggers = g_array_new(TRUE, TRUE, sizeof(lua_command_t));
+  for ( i = 0; i < LUA_TRIGGER_LAST; ++i ){
+    matcher = &plugin->trigger_matchers[i];
+    matcher->strings = g_ptr_array_new_with_free_func(g_free);
+    matcher->string_triggers = g_array_new(FALSE, FALSE, sizeof(guint));
+    matcher->output_nodes = g_array_new(FALSE, FALSE, sizeof(lua_trigger_output_t));
+  }
+  g_mutex_init(&plugin->call_lock);
+  g_mutex_init(&plugin->cache_lock);
+  plugin->result_cache = g_hash_table_new(g_str_hash, g_str_equal);
+  g_queue_init(&plugin->result_lru);
+  plugin->generator_ref = LUA_NOREF;
   return 0;
 }
 
@@ -79,6 +190,31 @@ static int
 lua_plugin_fini(IBusEnginePluginPrivate * plugin){
   size_t i;
   lua_command_t * command;
+  lua_trigger_matcher_t * matcher;
+
+  /* every pending call holds a reference of the plugin,
+     so the worker thread is idle here. */
+  if ( plugin->call_pool ){
+    g_thread_pool_free(plugin->call_pool, FALSE, FALSE);
+    plugin->call_pool = NULL;
+  }
+
+  if ( plugin->result_cache ){
+    lua_cached_result_t * cached;
+    while ( (cached = g_queue_pop_head(&plugin->result_lru)) ){
+      g_free(cached->key);
+      ibus_engine_plugin_candidates_unref(cached->candidates);
+      g_free(cached);
+    }
+    g_hash_table_destroy(plugin->result_cache);
+    plugin->result_cache = NULL;
+  }
+  g_mutex_clear(&plugin->cache_lock);
+
+  if ( plugin->command_index ){
+    g_hash_table_destroy(plugin->command_index);
+    plugin->command_index = NULL;
+  }
 
   if ( plugin->lua_commands ){
     for ( i = 0; i < plugin->lua_commands->len; ++i){
@@ -89,8 +225,30 @@ lua_plugin_fini(IBusEnginePluginPrivate * plugin){
     plugin->lua_commands = NULL;
   }
 
+  if ( plugin->lua_triggers ){
+    for ( i = 0; i < plugin->lua_triggers->len; ++i){
+      command = &g_array_index(plugin->lua_triggers, lua_command_t, i);
+      lua_command_reclaim(command);
+    }
+    g_array_free(plugin->lua_triggers, TRUE);
+    plugin->lua_triggers = NULL;
+  }
+
+  for ( i = 0; i < LUA_TRIGGER_LAST; ++i ){
+    matcher = &plugin->trigger_matchers[i];
+    if ( NULL == matcher->strings )
+      continue;
+    g_ptr_array_free(matcher->strings, TRUE);
+    g_array_free(matcher->string_triggers, TRUE);
+    g_array_free(matcher->output_nodes, TRUE);
+    g_free(matcher->next);
+    g_free(matcher->outputs);
+    memset(matcher, 0, sizeof(lua_trigger_matcher_t));
+  }
+
   lua_close(plugin->L);
   plugin->L = NULL;
+  g_mutex_clear(&plugin->call_lock);
   return 0;
 }
 
@@ -155,9 +313,104 @@ static int report (lua_State *L, int status) {
   return status;
 }
 
+/* compiled chunks are cached as ~/.cache/ibus/libpinyin/lua/<sha1 of path>.luac. */
+static char * lua_plugin_bytecode_filename(const char * filename){
+  GFile * file = g_file_new_for_path(filename);
+  char * path = g_file_get_path(file);
+  char * checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, path, -1);
+  char * name = g_strconcat(checksum, ".luac", NULL);
+  char * result = g_build_filename(g_get_user_cache_dir(), "ibus", "libpinyin",
+                                   "lua", name, NULL);
+
+  g_free(name);
+  g_free(checksum);
+  g_free(path);
+  g_object_unref(file);
+  return result;
+}
+
+static int lua_plugin_bytecode_writer(lua_State * L, const void * p, size_t sz, void * ud){
+  g_string_append_len((GString *) ud, p, sz);
+  return 0;
+}
+
+/* the header of a cached chunk: "<sha1 of the source> <lua version> <sha1 of the chunk>\n". */
+#define LUA_PLUGIN_BYTECODE_HEADER_LEN (40 + 1 + 3 + 1 + 40 + 1)
+
+/* load the script from its cached bytecode when the source is unchanged,
+   otherwise compile the source and refresh the cache.
+   lua 5.1 does not verify bytecode, so the chunk is checked before it is loaded. */
+static int lua_plugin_load_file(lua_State * L, const char * filename){
+  char * source, * prefix, * cache, * contents, * dirname, * checksum;
+  gsize source_len, length;
+  GString * bytecode;
+  int status;
+
+  if ( !g_file_get_contents(filename, &source, &source_len, NULL) )
+    return luaL_loadfile(L, filename);
+
+  /* the cache is valid for the same source and lua version. */
+  checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA1, (const guchar *) source, source_len);
+  prefix = g_strdup_printf("%s %03d ", checksum, LUA_VERSION_NUM);
+  g_free(checksum);
+  g_free(source);
+  cache = lua_plugin_bytecode_filename(filename);
+
+  if ( g_file_get_contents(cache, &contents, &length, NULL) ){
+    status = -1;
+    if ( length > LUA_PLUGIN_BYTECODE_HEADER_LEN &&
+         0 == memcmp(contents, prefix, strlen(prefix)) &&
+         '\n' == contents[LUA_PLUGIN_BYTECODE_HEADER_LEN - 1] ){
+      checksum = g_compute_checksum_for_data
+        (G_CHECKSUM_SHA1, (const guchar *) contents + LUA_PLUGIN_BYTECODE_HEADER_LEN,
+         length - LUA_PLUGIN_BYTECODE_HEADER_LEN);
+      if ( 0 == memcmp(contents + strlen(prefix), checksum, 40) ){
+        status = luaL_loadbuffer(L, contents + LUA_PLUGIN_BYTECODE_HEADER_LEN,
+                                 length - LUA_PLUGIN_BYTECODE_HEADER_LEN, filename);
+        if ( status )
+          lua_pop(L, 1);
+      }
+      g_free(checksum);
+    }
+    g_free(contents);
+    if ( 0 == status ){
+      g_free(cache);
+      g_free(prefix);
+      return 0;
+    }
+  }
+
+  status = luaL_loadfile(L, filename);
+  if ( 0 == status ){
+    bytecode = g_string_new(NULL);
+#if LUA_VERSION_NUM >= 503
+    lua_dump(L, lua_plugin_bytecode_writer, bytecode, 0);
+#else
+    lua_dump(L, lua_plugin_bytecode_writer, bytecode);
+#endif
+    checksum = g_compute_checksum_for_data(G_CHECKSUM_SHA1, (const guchar *) bytecode->str, bytecode->len);
+    g_string_prepend(bytecode, "\n");
+    g_string_prepend(bytecode, checksum);
+    g_string_prepend(bytecode, prefix);
+    g_free(checksum);
+
+    dirname = g_path_get_dirname(cache);
+    if ( 0 == g_mkdir_with_parents(dirname, 0700) )
+      g_file_set_contents(cache, bytecode->str, bytecode->len, NULL);
+    g_free(dirname);
+    g_string_free(bytecode, TRUE);
+  }
+
+  g_free(cache);
+  g_free(prefix);
+  return status;
+}
+
 int ibus_engine_plugin_load_lua_script(IBusEnginePlugin * plugin, const char * filename){
   IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
-  int status = luaL_dofile(priv->L, filename);
+  int status = lua_plugin_load_file(priv->L, filename);
+  if ( 0 == status )
+    status = lua_pcall(priv->L, 0, LUA_MULTRET, 0);
   return report(priv->L, status);
 }
 
@@ -168,19 +421,61 @@ static gint compare_command(gconstpointer a, gconstpointer b){
   return strcmp(ca->command_name, cb->command_name);
 }
 
+/* sort the commands once after registration, and index the prefixes. */
+static void lua_plugin_build_index(IBusEnginePluginPrivate * priv){
+  GArray * lua_commands = priv->lua_commands;
+  lua_command_t * command;
+  guint i; guchar first;
+
+  if ( !priv->commands_dirty )
+    return;
+
+  g_array_sort(lua_commands, compare_command);
+
+  memset(priv->prefix_start, 0, sizeof(priv->prefix_start));
+  memset(priv->prefix_count, 0, sizeof(priv->prefix_count));
+
+  g_hash_table_remove_all(priv->command_index);
+  for ( i = 0; i < lua_commands->len; ++i ){
+    command = &g_array_index(lua_commands, lua_command_t, i);
+    g_hash_table_insert(priv->command_index, (gpointer)command->command_name,
+                        GUINT_TO_POINTER(i + 1));
+
+    first = command->command_name[0];
+    if ( 0 == priv->prefix_count[first] )
+      priv->prefix_start[first] = i;
+    priv->prefix_count[first]++;
+  }
+
+  priv->commands_dirty = FALSE;
+}
+
 gboolean ibus_engine_plugin_add_command(IBusEnginePlugin * plugin, lua_command_t * command){
   IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
   GArray * lua_commands = priv->lua_commands;
 
-  if ( ibus_engine_plugin_lookup_command( plugin, command->command_name) )
+  if ( priv->worker_call ){
+    g_warning("lua command %s can't be registered from an asynchronous call.",
+              command->command_name);
+    return FALSE;
+  }
+
+  if ( g_hash_table_lookup(priv->command_index, command->command_name) )
     return FALSE;
 
   lua_command_t new_command;
   lua_command_clone(command, &new_command);
+  if ( new_command.instructions <= 0 )
+    new_command.instructions = LUA_PLUGIN_DEFAULT_INSTRUCTIONS;
+  if ( new_command.timeout <= 0 )
+    new_command.timeout = LUA_PLUGIN_DEFAULT_TIMEOUT;
 
   g_array_append_val(lua_commands, new_command);
-  /* Note: need to improve speed here? */
-  g_array_sort(lua_commands, compare_command);
+  /* the command strings are not moved by the append, and the
+     indexes stay valid until lua_plugin_build_index sorts them. */
+  g_hash_table_insert(priv->command_index, (gpointer)new_command.command_name,
+                      GUINT_TO_POINTER(lua_commands->len));
+  priv->commands_dirty = TRUE;
 
   return TRUE;
 }
@@ -188,20 +483,347 @@ gboolean ibus_engine_plugin_add_command(IBusEnginePlugin * plugin, lua_command_t
 const lua_command_t * ibus_engine_plugin_lookup_command(IBusEnginePlugin * plugin, const char * command_name){
   IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
   GArray * lua_commands = priv->lua_commands;
-  lua_command_t lookup_command = {.command_name = command_name, };
+  guint index;
 
-  lua_command_t * result = bsearch(&lookup_command, lua_commands->data, lua_commands->len, sizeof(lua_command_t), compare_command);
-  return result;
+  lua_plugin_build_index(priv);
+
+  index = GPOINTER_TO_UINT(g_hash_table_lookup(priv->command_index, command_name));
+  if ( 0 == index )
+    return NULL;
+  return &g_array_index(lua_commands, lua_command_t, index - 1);
 }
 
 const GArray * ibus_engine_plugin_get_available_commands(IBusEnginePlugin * plugin){
   IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  lua_plugin_build_index(priv);
   return priv->lua_commands;
 }
 
-int ibus_engine_plugin_call(IBusEnginePlugin * plugin, const char * lua_function_name, const char * argument /*optional, maybe NULL.*/){
+const lua_command_t * ibus_engine_plugin_get_commands_with_prefix(IBusEnginePlugin * plugin, const char * prefix, guint * count){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  GArray * lua_commands = priv->lua_commands;
+  const lua_command_t * command;
+  guchar first;
+
+  lua_plugin_build_index(priv);
+
+  if ( NULL == prefix || '\0' == prefix[0] ){
+    *count = lua_commands->len;
+    return (const lua_command_t *)lua_commands->data;
+  }
+
+  if ( '\0' != prefix[1] ){
+    command = ibus_engine_plugin_lookup_command(plugin, prefix);
+    *count = command ? 1 : 0;
+    return command;
+  }
+
+  first = prefix[0];
+  *count = priv->prefix_count[first];
+  if ( 0 == *count )
+    return NULL;
+  return &g_array_index(lua_commands, lua_command_t, priv->prefix_start[first]);
+}
+
+gboolean ibus_engine_plugin_add_trigger(IBusEnginePlugin * plugin, lua_trigger_t * trigger){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  const char * const * strings[LUA_TRIGGER_LAST];
+  lua_trigger_matcher_t * matcher;
+  lua_command_t command, new_command;
+  guint index = priv->lua_triggers->len;
+  int kind; size_t i;
+
+  if ( priv->worker_call ){
+    g_warning("lua trigger %s can't be registered from an asynchronous call.",
+              trigger->lua_function_name);
+    return FALSE;
+  }
+
+  /* triggers are called like commands, named after their function. */
+  memset(&command, 0, sizeof(command));
+  command.command_name = trigger->lua_function_name;
+  command.lua_function_name = trigger->lua_function_name;
+  command.description = trigger->description;
+  command.leading = "digit";
+  command.instructions = LUA_PLUGIN_DEFAULT_INSTRUCTIONS;
+  command.timeout = LUA_PLUGIN_DEFAULT_TIMEOUT;
+  lua_command_clone(&command, &new_command);
+  g_array_append_val(priv->lua_triggers, new_command);
+
+  strings[LUA_TRIGGER_INPUT] = trigger->input_trigger_strings;
+  strings[LUA_TRIGGER_CANDIDATE] = trigger->candidate_trigger_strings;
+  for ( kind = 0; kind < LUA_TRIGGER_LAST; ++kind ){
+    if ( NULL == strings[kind] )
+      continue;
+    matcher = &priv->trigger_matchers[kind];
+    for ( i = 0; strings[kind][i]; ++i ){
+      /* an empty string would match everything. */
+      if ( '\0' == strings[kind][i][0] )
+        continue;
+      g_ptr_array_add(matcher->strings, g_strdup(strings[kind][i]));
+      g_array_append_val(matcher->string_triggers, index);
+      matcher->dirty = TRUE;
+    }
+  }
+
+  return TRUE;
+}
+
+/* build the trie of the strings, then turn it into a dfa with the failure links. */
+static void lua_trigger_matcher_build(lua_trigger_matcher_t * matcher){
+  guint i, c, state, child, output, n_states = 1, max_states = 1;
+  guint head = 0, tail = 0;
+  guint * fail, * queue;
+  const guchar * p;
+  lua_trigger_output_t node;
+
+  for ( i = 0; i < matcher->strings->len; ++i )
+    max_states += strlen(g_ptr_array_index(matcher->strings, i));
+
+  g_free(matcher->next);
+  g_free(matcher->outputs);
+  g_array_set_size(matcher->output_nodes, 0);
+  matcher->next = g_new0(guint, max_states * 256);
+  matcher->outputs = g_new0(guint, max_states);
+  fail = g_new0(guint, max_states);
+  queue = g_new0(guint, max_states);
+
+  /* the trie, a zero transition goes back to the root. */
+  for ( i = 0; i < matcher->strings->len; ++i ){
+    state = 0;
+    for ( p = g_ptr_array_index(matcher->strings, i); *p; ++p ){
+      if ( 0 == matcher->next[state * 256 + *p] )
+        matcher->next[state * 256 + *p] = n_states++;
+      state = matcher->next[state * 256 + *p];
+    }
+    node.trigger = g_array_index(matcher->string_triggers, guint, i);
+    node.next = matcher->outputs[state];
+    g_array_append_val(matcher->output_nodes, node);
+    matcher->outputs[state] = matcher->output_nodes->len;
+  }
+
+  for ( c = 0; c < 256; ++c ){
+    if ( matcher->next[c] )
+      queue[tail++] = matcher->next[c];
+  }
+
+  /* breadth first, so the failure state of a state is complete before it. */
+  while ( head < tail ){
+    state = queue[head++];
+
+    /* the outputs of the failure state follow the own outputs. */
+    output = matcher->outputs[state];
+    if ( 0 == output ){
+      matcher->outputs[state] = matcher->outputs[fail[state]];
+    } else {
+      while ( g_array_index(matcher->output_nodes, lua_trigger_output_t, output - 1).next )
+        output = g_array_index(matcher->output_nodes, lua_trigger_output_t, output - 1).next;
+      g_array_index(matcher->output_nodes, lua_trigger_output_t, output - 1).next =
+        matcher->outputs[fail[state]];
+    }
+
+    for ( c = 0; c < 256; ++c ){
+      child = matcher->next[state * 256 + c];
+      if ( child ){
+        fail[child] = matcher->next[fail[state] * 256 + c];
+        queue[tail++] = child;
+      } else {
+        matcher->next[state * 256 + c] = matcher->next[fail[state] * 256 + c];
+      }
+    }
+  }
+
+  g_free(queue);
+  g_free(fail);
+  matcher->dirty = FALSE;
+}
+
+guint ibus_engine_plugin_match_triggers(IBusEnginePlugin * plugin, lua_trigger_kind_t kind, const char * text, const lua_command_t ** triggers, guint max){
   IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
-  int type; int result;
+  lua_trigger_matcher_t * matcher = &priv->trigger_matchers[kind];
+  const lua_trigger_output_t * node;
+  const lua_command_t * trigger;
+  const guchar * p;
+  guint state = 0, output, count = 0, i;
+
+  /* the common case, nothing to match. */
+  if ( 0 == matcher->strings->len || 0 == max )
+    return 0;
+
+  if ( matcher->dirty )
+    lua_trigger_matcher_build(matcher);
+
+  for ( p = (const guchar *) text; *p; ++p ){
+    state = matcher->next[state * 256 + *p];
+    for ( output = matcher->outputs[state]; output; output = node->next ){
+      node = &g_array_index(matcher->output_nodes, lua_trigger_output_t, output - 1);
+      trigger = &g_array_index(priv->lua_triggers, lua_command_t, node->trigger);
+
+      for ( i = 0; i < count && triggers[i] != trigger; ++i );
+      if ( i < count )
+        continue;
+
+      triggers[count++] = trigger;
+      if ( count == max )
+        return count;
+    }
+  }
+
+  return count;
+}
+
+static void lua_plugin_budget_hook(lua_State * L, lua_Debug * ar){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(lua_plugin_retrieve_plugin(L));
+
+  if ( priv->call_cancellable &&
+       g_cancellable_is_cancelled(priv->call_cancellable) ){
+    luaL_error(L, "lua call cancelled.");
+  }
+
+  priv->call_instructions -= LUA_PLUGIN_HOOK_COUNT;
+  if ( priv->call_instructions <= 0 ||
+       g_get_monotonic_time() > priv->call_deadline ){
+    /* keep raising the error, in case the script catches it with pcall. */
+    priv->call_timed_out = TRUE;
+    luaL_error(L, "lua call exceeded its budget.");
+  }
+}
+
+static void lua_plugin_begin_budget(IBusEnginePluginPrivate * priv, int instructions, int timeout, GCancellable * cancellable){
+  priv->call_instructions = instructions;
+  priv->call_deadline = g_get_monotonic_time() + (gint64) timeout * 1000;
+  priv->call_timed_out = FALSE;
+  priv->call_cancellable = cancellable;
+
+  lua_sethook(priv->L, lua_plugin_budget_hook, LUA_MASKCOUNT, LUA_PLUGIN_HOOK_COUNT);
+}
+
+static void lua_plugin_end_budget(IBusEnginePluginPrivate * priv){
+  lua_sethook(priv->L, NULL, 0, 0);
+  priv->call_cancellable = NULL;
+}
+
+/* pull the items of the generator at the top of the stack into its items table,
+   until there are len items, return whether more items may follow. */
+static gboolean lua_plugin_generator_pull(lua_State * L, guint len){
+  int generator = lua_gettop(L);
+  int items, status;
+  lua_Integer count = -1;
+  lua_State * co;
+  guint n;
+
+  lua_getfield(L, generator, "done");
+  if ( lua_toboolean(L, -1) ){
+    lua_pop(L, 1);
+    return FALSE;
+  }
+  lua_pop(L, 1);
+
+  lua_getfield(L, generator, "count");
+  if ( lua_isnumber(L, -1) )
+    count = lua_tointeger(L, -1);
+  lua_pop(L, 1);
+
+  lua_getfield(L, generator, "items");
+  items = lua_gettop(L);
+  n = lua_objlen(L, items);
+
+  while ( n < len ){
+    if ( count >= 0 ){
+      /* the (count, fetch) pair. */
+      if ( n >= count ){
+        lua_pushnil(L);
+        status = 0;
+      } else {
+        lua_getfield(L, generator, "fetch");
+        lua_pushinteger(L, n + 1);
+        status = lua_pcall(L, 1, 1, 0);
+      }
+    } else {
+      lua_getfield(L, generator, "next");
+      if ( lua_isthread(L, -1) ){
+        /* hooks are per thread, budget the coroutine too. */
+        co = lua_tothread(L, -1);
+        lua_pop(L, 1);
+        lua_sethook(co, lua_plugin_budget_hook, LUA_MASKCOUNT, LUA_PLUGIN_HOOK_COUNT);
+        status = lua_plugin_resume(co, L);
+        lua_sethook(co, NULL, 0, 0);
+        if ( LUA_YIELD == status && lua_gettop(co) > 0 ){
+          lua_xmove(co, L, 1);
+        } else {
+          lua_pushnil(L);
+        }
+        /* the next resume passes the stack of the coroutine to yield. */
+        if ( LUA_YIELD == status )
+          lua_settop(co, 0);
+        status = 0;
+      } else {
+        status = lua_pcall(L, 0, 1, 0);
+      }
+    }
+
+    /* an error or nil ends the results. */
+    if ( status || lua_isnil(L, -1) ){
+      lua_pop(L, 1);
+      lua_pushboolean(L, 1);
+      lua_setfield(L, generator, "done");
+      lua_pop(L, 1);
+      return FALSE;
+    }
+
+    lua_rawseti(L, items, ++n);
+  }
+
+  lua_pop(L, 1);
+  return count < 0 || n < count;
+}
+
+/* turn the (count, fetch) pair, the iterator or the coroutine at the top of
+   the stack into a generator, and leave its first items as the retval. */
+static int lua_plugin_start_generator(IBusEnginePluginPrivate * priv, gboolean pair){
+  lua_State * L = priv->L;
+  int top = lua_gettop(L);
+  int len;
+
+  lua_newtable(L);
+  if ( pair ){
+    lua_pushvalue(L, top - 1);
+    lua_setfield(L, -2, "count");
+    lua_pushvalue(L, top);
+    lua_setfield(L, -2, "fetch");
+    lua_replace(L, top - 1);
+    lua_settop(L, top - 1);
+  } else {
+    lua_pushvalue(L, top);
+    lua_setfield(L, -2, "next");
+    lua_replace(L, top);
+  }
+  lua_newtable(L);
+  lua_setfield(L, -2, "items");
+
+  /* only the last generator is kept. */
+  luaL_unref(L, LUA_REGISTRYINDEX, priv->generator_ref);
+  lua_pushvalue(L, -1);
+  priv->generator_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  priv->generator_serial++;
+
+  priv->generator_more = lua_plugin_generator_pull(L, LUA_PLUGIN_GENERATOR_PREFETCH);
+  priv->generator_pending = TRUE;
+
+  lua_getfield(L, -1, "items");
+  lua_remove(L, -2);
+  len = lua_objlen(L, -1);
+
+  /* no retval is left without results. */
+  if ( 0 == len ){
+    priv->generator_pending = FALSE;
+    lua_pop(L, 1);
+  }
+  return len;
+}
+
+static int lua_plugin_call(IBusEnginePluginPrivate * priv, const char * lua_function_name, const char * argument, int instructions, int timeout, GCancellable * cancellable){
+  int type; int result; gboolean pair;
 
   lua_State * L = priv->L;
 
@@ -212,23 +834,260 @@ int ibus_engine_plugin_call(IBusEnginePlugin * plugin, const char * lua_function
   /* check whether lua_function_name exists. */
   lua_getglobal(L, lua_function_name);
   type = lua_type(L, -1);
-  if ( LUA_TFUNCTION != type )
+  if ( LUA_TFUNCTION != type ){
+    lua_pop(L, 1);
     return 0;
+  }
   lua_pushstring(L, argument);
 
-  result = lua_pcall(L, 1, 1, 0);
-  if (result) return 0;
+  priv->generator_pending = FALSE;
+
+  /* two results, for the (count, fetch) pair. */
+  lua_plugin_begin_budget(priv, instructions, timeout, cancellable);
+  result = lua_pcall(L, 1, 2, 0);
+
+  if ( priv->call_timed_out ){
+    lua_plugin_end_budget(priv);
+    lua_pop(L, result ? 1 : 2);
+    return LUA_PLUGIN_CALL_TIMED_OUT;
+  }
+
+  if ( cancellable && g_cancellable_is_cancelled(cancellable) ){
+    lua_plugin_end_budget(priv);
+    lua_pop(L, result ? 1 : 2);
+    return LUA_PLUGIN_CALL_CANCELLED;
+  }
+
+  if (result){
+    lua_plugin_end_budget(priv);
+    lua_pop(L, 1);
+    return 0;
+  }
+
+  /* decide while both results are on the stack. */
+  pair = lua_isfunction(L, -1) && LUA_TNUMBER == lua_type(L, -2);
+  if ( !pair )
+    lua_pop(L, 1);
+
+  /* the lazy results are pulled with the rest of the budget. */
+  if ( pair || lua_isfunction(L, -1) || lua_isthread(L, -1) ){
+    result = lua_plugin_start_generator(priv, pair);
+    lua_plugin_end_budget(priv);
+    return result;
+  }
+  lua_plugin_end_budget(priv);
 
   type = lua_type(L, -1);
   if ( LUA_TTABLE == type ){
-    return lua_objlen(L, -1);
+    /* the retval is popped by its getter, only called for results. */
+    result = lua_objlen(L, -1);
+    if ( 0 == result )
+      lua_pop(L, 1);
+    return result;
   } else if (LUA_TNUMBER == type || LUA_TBOOLEAN == type || LUA_TSTRING == type){
     return 1;
   }
 
+  lua_pop(L, 1);
   return 0;
 }
 
+int ibus_engine_plugin_call(IBusEnginePlugin * plugin, const char * lua_function_name, const char * argument /*optional, maybe NULL.*/){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+
+  return lua_plugin_call(priv, lua_function_name, argument,
+                         LUA_PLUGIN_DEFAULT_INSTRUCTIONS, LUA_PLUGIN_DEFAULT_TIMEOUT, NULL);
+}
+
+static int lua_plugin_call_command(IBusEnginePluginPrivate * priv, const lua_command_t * command, const char * argument, GCancellable * cancellable){
+  /* the command is owned by priv->lua_commands. */
+  lua_command_t * owned = (lua_command_t *) command;
+  int result;
+
+  if ( owned->timeouts >= LUA_PLUGIN_MAX_TIMEOUTS )
+    return LUA_PLUGIN_CALL_TIMED_OUT;
+
+  result = lua_plugin_call(priv, owned->lua_function_name, argument,
+                           owned->instructions, owned->timeout, cancellable);
+
+  if ( LUA_PLUGIN_CALL_TIMED_OUT == result ){
+    owned->timeouts++;
+    if ( owned->timeouts >= LUA_PLUGIN_MAX_TIMEOUTS )
+      g_warning("lua command %s timed out %d times, and is disabled.",
+                owned->command_name, owned->timeouts);
+  }
+
+  return result;
+}
+
+int ibus_engine_plugin_call_command(IBusEnginePlugin * plugin, const lua_command_t * command, const char * argument /*optional, maybe NULL.*/){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  return lua_plugin_call_command(priv, command, argument, NULL);
+}
+
+static void lua_call_data_free(gpointer data){
+  lua_call_data_t * call = data;
+
+  if ( call->candidates )
+    ibus_engine_plugin_candidates_unref(call->candidates);
+  if ( call->previous )
+    ibus_engine_plugin_candidates_unref(call->previous);
+  g_free(call->argument);
+  g_free(call);
+}
+
+/* return a new reference of the cached results, or NULL. */
+static lua_command_candidates_t * lua_plugin_cache_lookup(IBusEnginePluginPrivate * priv, const lua_command_t * command, const char * argument){
+  char * key = g_strconcat(command->command_name, argument, NULL);
+  lua_command_candidates_t * candidates = NULL;
+  GList * link;
+
+  g_mutex_lock(&priv->cache_lock);
+  link = g_hash_table_lookup(priv->result_cache, key);
+  if ( link ){
+    g_queue_unlink(&priv->result_lru, link);
+    g_queue_push_head_link(&priv->result_lru, link);
+    candidates = ibus_engine_plugin_candidates_ref(((lua_cached_result_t *) link->data)->candidates);
+  }
+  g_mutex_unlock(&priv->cache_lock);
+
+  g_free(key);
+  return candidates;
+}
+
+static void lua_plugin_cache_insert(IBusEnginePluginPrivate * priv, const lua_command_t * command, const char * argument, lua_command_candidates_t * candidates){
+  lua_cached_result_t * cached;
+
+  g_mutex_lock(&priv->cache_lock);
+
+  cached = g_new0(lua_cached_result_t, 1);
+  /* command names are 2-char long, so the key is unambiguous. */
+  cached->key = g_strconcat(command->command_name, argument, NULL);
+  if ( g_hash_table_contains(priv->result_cache, cached->key) ){
+    g_free(cached->key);
+    g_free(cached);
+    g_mutex_unlock(&priv->cache_lock);
+    return;
+  }
+  cached->candidates = ibus_engine_plugin_candidates_ref(candidates);
+  g_queue_push_head(&priv->result_lru, cached);
+  g_hash_table_insert(priv->result_cache, cached->key, priv->result_lru.head);
+
+  if ( priv->result_lru.length > LUA_PLUGIN_RESULT_CACHE_SIZE ){
+    cached = g_queue_pop_tail(&priv->result_lru);
+    g_hash_table_remove(priv->result_cache, cached->key);
+    g_free(cached->key);
+    ibus_engine_plugin_candidates_unref(cached->candidates);
+    g_free(cached);
+  }
+
+  g_mutex_unlock(&priv->cache_lock);
+}
+
+/* defined with ibus_engine_plugin_fetch_candidates, call with call_lock held. */
+static lua_command_candidates_t * lua_plugin_fetch(IBusEnginePluginPrivate * priv, const lua_command_candidates_t * candidates, guint len, GCancellable * cancellable);
+
+static lua_plugin_trace_func_t lua_plugin_trace_func = NULL;
+
+void ibus_engine_plugin_set_trace_func(lua_plugin_trace_func_t func){
+  lua_plugin_trace_func = func;
+}
+
+/* runs on the worker thread. */
+static void lua_plugin_call_worker(gpointer data, gpointer user_data){
+  GTask * task = data;
+  IBusEnginePlugin * plugin = g_task_get_source_object(task);
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  GCancellable * cancellable = g_task_get_cancellable(task);
+  lua_call_data_t * call = g_task_get_task_data(task);
+  gint64 start = 0;
+
+  g_mutex_lock(&priv->call_lock);
+  priv->worker_call = TRUE;
+  if ( lua_plugin_trace_func )
+    start = g_get_monotonic_time();
+
+  if ( call->previous ){
+    if ( !g_cancellable_is_cancelled(cancellable) )
+      call->candidates = lua_plugin_fetch(priv, call->previous, call->len, cancellable);
+    if ( start )
+      lua_plugin_trace_func("ibus_engine_plugin_fetch_candidates", start,
+                            g_get_monotonic_time() - start);
+    priv->worker_call = FALSE;
+    g_mutex_unlock(&priv->call_lock);
+    g_task_return_boolean(task, TRUE);
+    g_object_unref(task);
+    return;
+  }
+
+  if ( g_cancellable_is_cancelled(cancellable) ){
+    call->result = LUA_PLUGIN_CALL_CANCELLED;
+  } else {
+    call->result = lua_plugin_call_command
+      (priv, call->command, call->argument, cancellable);
+  }
+
+  /* collect the results here, while the lua stack is ours. */
+  if ( call->result > 0 )
+    call->candidates = ibus_engine_plugin_get_candidates(plugin);
+  if ( start )
+    lua_plugin_trace_func("ibus_engine_plugin_call", start,
+                          g_get_monotonic_time() - start);
+
+  priv->worker_call = FALSE;
+  g_mutex_unlock(&priv->call_lock);
+
+  if ( call->candidates && !call->candidates->more && call->command->pure )
+    lua_plugin_cache_insert(priv, call->command, call->argument, call->candidates);
+
+  g_task_return_boolean(task, TRUE);
+  g_object_unref(task);
+}
+
+void ibus_engine_plugin_call_command_async(IBusEnginePlugin * plugin, const lua_command_t * command, const char * argument /*optional, maybe NULL.*/, GCancellable * cancellable, GAsyncReadyCallback callback, gpointer user_data){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  lua_call_data_t * call;
+  GTask * task;
+
+  if ( NULL == priv->call_pool ){
+    /* the lua state is not thread safe, use one thread only. */
+    priv->call_pool = g_thread_pool_new(lua_plugin_call_worker, NULL, 1, FALSE, NULL);
+  }
+
+  call = g_new0(lua_call_data_t, 1);
+  call->command = (lua_command_t *) command;
+  call->argument = g_strdup(argument ? argument : "");
+
+  /* the task holds a reference of the plugin until the callback returns. */
+  task = g_task_new(plugin, cancellable, callback, user_data);
+  g_task_set_task_data(task, call, lua_call_data_free);
+
+  /* repeated inputs of pure commands skip the lua call. */
+  if ( command->pure ){
+    call->candidates = lua_plugin_cache_lookup(priv, command, call->argument);
+    if ( call->candidates ){
+      call->result = call->candidates->len;
+      g_task_return_boolean(task, TRUE);
+      g_object_unref(task);
+      return;
+    }
+  }
+
+  g_thread_pool_push(priv->call_pool, task, NULL);
+}
+
+int ibus_engine_plugin_call_command_finish(IBusEnginePlugin * plugin, GAsyncResult * result, lua_command_candidates_t ** candidates){
+  GTask * task = G_TASK(result);
+  lua_call_data_t * call;
+
+  g_return_val_if_fail(g_task_is_valid(result, plugin), 0);
+
+  call = g_task_get_task_data(task);
+  *candidates = call->candidates;
+  call->candidates = NULL;
+  return call->result;
+}
+
 /**
  * get a candidate from lua return value.
  */
@@ -317,4 +1176,232 @@ void ibus_engine_plugin_free_candidate(lua_command_candidate_t * candidate){
   g_free((gpointer)candidate->content);
   g_free((gpointer)candidate->suggest);
   g_free((gpointer)candidate->help);
+  /* allocated by ibus_engine_plugin_get_candidate or _get_retval. */
+  free(candidate);
+}
+
+/* copy the string at index into the blob up to end,
+   or measure it when field is NULL. */
+static size_t lua_candidate_copy_string(lua_State * L, int index, const char ** field, char ** blob, const char * end){
+  size_t len;
+  const char * str = lua_tolstring(L, index, &len);
+
+  if ( NULL == str )
+    return 0;
+
+  if ( field ){
+    /* never write past the measured size. */
+    if ( len + 1 > (size_t)(end - *blob) )
+      return 0;
+    memcpy(*blob, str, len + 1);
+    *field = *blob;
+    *blob += len + 1;
+  }
+  return len + 1;
+}
+
+/* marshal the candidate at the top of the stack, or measure it when candidate is NULL.
+   the raw accesses run no metamethods, so both passes see the same strings. */
+static size_t lua_candidate_marshal(lua_State * L, lua_command_candidate_t * candidate, char ** blob, const char * end){
+  size_t size = 0;
+  int type = lua_type(L, -1);
+
+  if ( LUA_TTABLE == type ){
+    lua_pushliteral(L, "suggest");
+    lua_rawget(L, -2);
+    lua_pushliteral(L, "help");
+    lua_rawget(L, -3);
+    size += lua_candidate_copy_string(L, -2, candidate ? &candidate->suggest : NULL, blob, end);
+    size += lua_candidate_copy_string(L, -1, candidate ? &candidate->help : NULL, blob, end);
+    lua_pop(L, 2);
+  } else if (LUA_TNUMBER == type || LUA_TBOOLEAN == type || LUA_TSTRING == type) {
+    size += lua_candidate_copy_string(L, -1, candidate ? &candidate->content : NULL, blob, end);
+  }
+
+  return size;
+}
+
+/* walk the candidates of the retval at the top of the stack from index from. */
+static size_t lua_candidates_marshal(lua_State * L, guint from, guint len, lua_command_candidates_t * candidates, char ** blob, const char * end){
+  size_t size = 0; guint i;
+
+  if ( LUA_TTABLE != lua_type(L, -1) )
+    return lua_candidate_marshal(L, candidates ? &candidates->candidates[0] : NULL, blob, end);
+
+  for ( i = from; i < len; ++i ){
+    lua_rawgeti(L, -1, i + 1);
+    size += lua_candidate_marshal(L, candidates ? &candidates->candidates[i] : NULL, blob, end);
+    lua_pop(L, 1);
+  }
+  return size;
+}
+
+/* marshal the len candidates of the retval at the top of the stack,
+   the ones of previous are shared instead of marshalled again. */
+static lua_command_candidates_t * lua_candidates_new(lua_State * L, guint len, const lua_command_candidates_t * previous){
+  lua_command_candidates_t * candidates;
+  lua_candidate_strings_t * strings;
+  guint from = previous ? previous->len : 0;
+  size_t size; char * blob;
+
+  /* measure the strings first, then copy them into one block. */
+  size = lua_candidates_marshal(L, from, len, NULL, NULL, NULL);
+  strings = g_malloc(sizeof(lua_candidate_strings_t) + size);
+  strings->ref_count = 1;
+  strings->previous = NULL;
+
+  candidates = g_malloc0(sizeof(lua_command_candidates_t) + len * sizeof(lua_command_candidate_t));
+  candidates->ref_count = 1;
+  candidates->len = len;
+  candidates->candidates = (lua_command_candidate_t *)(candidates + 1);
+  candidates->strings = strings;
+
+  if ( previous ){
+    memcpy(candidates->candidates, previous->candidates, from * sizeof(lua_command_candidate_t));
+    strings->previous = previous->strings;
+    g_atomic_int_inc(&strings->previous->ref_count);
+  }
+
+  blob = (char *)(strings + 1);
+  lua_candidates_marshal(L, from, len, candidates, &blob, blob + size);
+  g_assert(blob <= (char *)(strings + 1) + size);
+  return candidates;
+}
+
+lua_command_candidates_t * ibus_engine_plugin_get_candidates(IBusEnginePlugin * plugin){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  lua_State * L = priv->L;
+  lua_command_candidates_t * candidates;
+  guint len;
+
+  int type = lua_type(L, -1);
+  if ( LUA_TTABLE == type ){
+    len = lua_objlen(L, -1);
+  } else if (LUA_TNUMBER == type || LUA_TBOOLEAN == type || LUA_TSTRING == type) {
+    len = 1;
+  } else {
+    lua_pop(L, 1);
+    return NULL;
+  }
+
+  candidates = lua_candidates_new(L, len, NULL);
+
+  if ( priv->generator_pending ){
+    candidates->more = priv->generator_more;
+    candidates->generator = priv->generator_serial;
+    priv->generator_pending = FALSE;
+  }
+
+  lua_pop(L, 1);
+  return candidates;
+}
+
+static lua_command_candidates_t * lua_plugin_fetch(IBusEnginePluginPrivate * priv, const lua_command_candidates_t * candidates, guint len, GCancellable * cancellable){
+  lua_State * L = priv->L;
+  lua_command_candidates_t * fetched;
+  gboolean more;
+  guint n;
+
+  /* the generator is released by the next lazy result. */
+  if ( !candidates->more || candidates->generator != priv->generator_serial )
+    return NULL;
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, priv->generator_ref);
+  lua_plugin_begin_budget(priv, LUA_PLUGIN_DEFAULT_INSTRUCTIONS, LUA_PLUGIN_DEFAULT_TIMEOUT, cancellable);
+  more = lua_plugin_generator_pull(L, len);
+  lua_plugin_end_budget(priv);
+
+  lua_getfield(L, -1, "items");
+  lua_remove(L, -2);
+  n = lua_objlen(L, -1);
+
+  /* only the new items are marshalled. */
+  fetched = lua_candidates_new(L, MAX(n, candidates->len), candidates);
+  fetched->more = more;
+  fetched->generator = candidates->generator;
+  lua_pop(L, 1);
+  return fetched;
+}
+
+lua_command_candidates_t * ibus_engine_plugin_fetch_candidates(IBusEnginePlugin * plugin, const lua_command_candidates_t * candidates, guint len){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  lua_command_candidates_t * fetched;
+
+  if ( !candidates->more )
+    return NULL;
+
+  g_mutex_lock(&priv->call_lock);
+  fetched = lua_plugin_fetch(priv, candidates, len, NULL);
+  g_mutex_unlock(&priv->call_lock);
+  return fetched;
+}
+
+void ibus_engine_plugin_fetch_candidates_async(IBusEnginePlugin * plugin, lua_command_candidates_t * candidates, guint len, GCancellable * cancellable, GAsyncReadyCallback callback, gpointer user_data){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  lua_call_data_t * call;
+  GTask * task;
+
+  call = g_new0(lua_call_data_t, 1);
+  call->previous = ibus_engine_plugin_candidates_ref(candidates);
+  call->len = len;
+
+  task = g_task_new(plugin, cancellable, callback, user_data);
+  g_task_set_task_data(task, call, lua_call_data_free);
+
+  if ( !candidates->more ){
+    g_task_return_boolean(task, TRUE);
+    g_object_unref(task);
+    return;
+  }
+
+  if ( NULL == priv->call_pool ){
+    /* the lua state is not thread safe, use one thread only. */
+    priv->call_pool = g_thread_pool_new(lua_plugin_call_worker, NULL, 1, FALSE, NULL);
+  }
+  g_thread_pool_push(priv->call_pool, task, NULL);
+}
+
+lua_command_candidates_t * ibus_engine_plugin_fetch_candidates_finish(IBusEnginePlugin * plugin, GAsyncResult * result){
+  GTask * task = G_TASK(result);
+  lua_call_data_t * call;
+  lua_command_candidates_t * fetched;
+
+  g_return_val_if_fail(g_task_is_valid(result, plugin), NULL);
+
+  call = g_task_get_task_data(task);
+  fetched = call->candidates;
+  call->candidates = NULL;
+  return fetched;
+}
+
+lua_command_candidates_t * ibus_engine_plugin_candidates_ref(lua_command_candidates_t * candidates){
+  g_atomic_int_inc(&candidates->ref_count);
+  return candidates;
+}
+
+void ibus_engine_plugin_candidates_unref(lua_command_candidates_t * candidates){
+  lua_candidate_strings_t * strings, * previous;
+
+  if ( !g_atomic_int_dec_and_test(&candidates->ref_count) )
+    return;
+
+  strings = candidates->strings;
+  g_free(candidates);
+
+  while ( strings && g_atomic_int_dec_and_test(&strings->ref_count) ){
+    previous = strings->previous;
+    g_free(strings);
+    strings = previous;
+  }
+}
+
+size_t ibus_engine_plugin_get_memory_usage(IBusEnginePlugin * plugin){
+  IBusEnginePluginPrivate * priv = IBUS_ENGINE_PLUGIN_GET_PRIVATE(plugin);
+  lua_State * L = priv->L;
+  size_t size;
+
+  g_mutex_lock(&priv->call_lock);
+  size = (size_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+  g_mutex_unlock(&priv->call_lock);
+  return size;
 }
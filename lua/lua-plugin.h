@@ -28,6 +28,7 @@
 #include <lauxlib.h>
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #define LUA_IMELIBNAME   "ime"
 LUALIB_API int (luaopen_ime) (lua_State * L);
@@ -41,24 +42,51 @@ typedef struct _lua_command_t{
   const char * description;
   const char * leading; /* optional, default "digit". */
   const char * help; /* optional. */
+  int instructions; /* optional, budget of lua instructions per call. */
+  int timeout; /* optional, budget of milliseconds per call. */
+  gboolean pure; /* optional, the results only depend on the argument. */
+  /*< private >*/
+  int timeouts; /* number of calls which exceeded the budget. */
 } lua_command_t;
 
+/* returned by ibus_engine_plugin_call* when the call exceeded its budget. */
+#define LUA_PLUGIN_CALL_TIMED_OUT (-1)
+/* returned by ibus_engine_plugin_call_command_finish when the call was cancelled. */
+#define LUA_PLUGIN_CALL_CANCELLED (-2)
+
 typedef struct _lua_command_candidate_t{
   const char * suggest;
   const char * help;
   const char * content;
 } lua_command_candidate_t;
 
+/* the candidates of a call, with their strings, in one block. */
+typedef struct _lua_command_candidates_t{
+  /*< private >*/
+  int ref_count;
+  /*< public >*/
+  guint len;
+  lua_command_candidate_t * candidates;
+  /* more candidates may be fetched with ibus_engine_plugin_fetch_candidates. */
+  gboolean more;
+  /*< private >*/
+  int generator;
+  gpointer strings; /* shared with the candidates fetched later. */
+} lua_command_candidates_t;
+
 typedef struct _lua_trigger_t{
   const char * lua_function_name;
   const char * description;
-  /*< private, skip it, and register it into Special Table directly with * wildcard. >*/
-  /*
-   * list of input_trigger_strings;
-   * list of candidate_trigger_strings;
-   */
+  const char * const * input_trigger_strings; /* NULL terminated, maybe NULL. */
+  const char * const * candidate_trigger_strings; /* NULL terminated, maybe NULL. */
 } lua_trigger_t;
 
+typedef enum{
+  LUA_TRIGGER_INPUT,
+  LUA_TRIGGER_CANDIDATE,
+  LUA_TRIGGER_LAST,
+} lua_trigger_kind_t;
+
 /*
  * Type macros.
  */
@@ -76,6 +104,7 @@ typedef struct _IBusEnginePluginPrivate IBusEnginePluginPrivate;
 
 void lua_plugin_openlibs (lua_State *L);
 void lua_plugin_store_plugin(lua_State * L, IBusEnginePlugin * plugin);
+IBusEnginePlugin * lua_plugin_retrieve_plugin(lua_State * L);
 
 struct _IBusEnginePlugin
 {
@@ -104,6 +133,8 @@ int ibus_engine_plugin_load_lua_script(IBusEnginePlugin * plugin, const char * f
 
 /**
  * add a lua_command_t to plugin.
+ * commands are registered on the main thread, registering from an
+ * asynchronous call fails, as the main thread reads the commands meanwhile.
  */
 gboolean ibus_engine_plugin_add_command(IBusEnginePlugin * plugin, lua_command_t * command);
 
@@ -120,13 +151,57 @@ const GArray * ibus_engine_plugin_get_available_commands(IBusEnginePlugin * plug
  */
 const lua_command_t * ibus_engine_plugin_lookup_command(IBusEnginePlugin * plugin, const char * command_name);
 
+/**
+ * retrieve the commands whose name starts with prefix, in name order.
+ * prefix may be empty, 1-char or 2-char long.
+ * return the first matched command, and store the number of matches in count.
+ */
+const lua_command_t * ibus_engine_plugin_get_commands_with_prefix(IBusEnginePlugin * plugin, const char * prefix, guint * count);
+
+/**
+ * add a lua_trigger_t to plugin, on the main thread like commands.
+ */
+gboolean ibus_engine_plugin_add_trigger(IBusEnginePlugin * plugin, lua_trigger_t * trigger);
+
+/**
+ * find the triggers with a trigger string of kind in text,
+ * in one pass over text whatever the number of trigger strings.
+ * store at most max triggers in triggers, in the order of their first match.
+ * the triggers are called with ibus_engine_plugin_call_command*.
+ * return the number of stored triggers.
+ */
+guint ibus_engine_plugin_match_triggers(IBusEnginePlugin * plugin, lua_trigger_kind_t kind, const char * text, const lua_command_t ** triggers, guint max);
+
 /**
  * retval int: returns the number of results,
  *              only support string or string array.
  * the consequence call of ibus_engine_plugin_get_retval* must follow this call immediately.
+ * the call runs with the default budget, and returns LUA_PLUGIN_CALL_TIMED_OUT if it is exceeded.
  */
 int ibus_engine_plugin_call(IBusEnginePlugin * plugin, const char * lua_function_name, const char * argument /*optional, maybe NULL.*/);
 
+/**
+ * same as ibus_engine_plugin_call, with the budget of the command.
+ * a command which exceeded its budget too many times is not called any more,
+ * and always returns LUA_PLUGIN_CALL_TIMED_OUT.
+ */
+int ibus_engine_plugin_call_command(IBusEnginePlugin * plugin, const lua_command_t * command, const char * argument /*optional, maybe NULL.*/);
+
+/**
+ * call the command on the worker thread of the plugin, calls are run one by one.
+ * a cancelled call is skipped, or aborted if it is already running.
+ * callback is invoked in the thread-default main context of the caller.
+ * don't make synchronous calls while an asynchronous call is pending.
+ */
+void ibus_engine_plugin_call_command_async(IBusEnginePlugin * plugin, const lua_command_t * command, const char * argument /*optional, maybe NULL.*/, GCancellable * cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * retval int: returns the number of results, or LUA_PLUGIN_CALL_TIMED_OUT, LUA_PLUGIN_CALL_CANCELLED.
+ * the results are stored in candidates, release them with ibus_engine_plugin_candidates_unref.
+ * the results of pure commands are cached, and may be shared between calls.
+ */
+int ibus_engine_plugin_call_command_finish(IBusEnginePlugin * plugin, GAsyncResult * result, lua_command_candidates_t ** candidates);
+
 /**
  * retrieve the retval string value. (value has been copied.)
  */
@@ -137,5 +212,54 @@ const lua_command_candidate_t * ibus_engine_plugin_get_retval(IBusEnginePlugin *
  */
 GArray * ibus_engine_plugin_get_retvals(IBusEnginePlugin * plugin);
 
+/**
+ * free a candidate from ibus_engine_plugin_get_retval or ibus_engine_plugin_get_retvals.
+ */
 void ibus_engine_plugin_free_candidate(lua_command_candidate_t * candidate);
+
+/**
+ * retrieve the retval as candidates, with their strings marshalled into one allocation.
+ * the call must follow ibus_engine_plugin_call immediately, like ibus_engine_plugin_get_retval*.
+ * return NULL if the retval is not a string or an array.
+ */
+lua_command_candidates_t * ibus_engine_plugin_get_candidates(IBusEnginePlugin * plugin);
+
+/**
+ * commands may return their results lazily, as an iterator function, a coroutine
+ * or a (count, fetch(i)) pair, then the call only pulls the first results.
+ * fetch the results of such a call up to len, with the default budget.
+ * return the candidates including the previous ones, or NULL if the results
+ * can't be fetched any more, as only the last lazy result of the plugin is kept.
+ * only the new results are marshalled, the previous ones are shared.
+ */
+lua_command_candidates_t * ibus_engine_plugin_fetch_candidates(IBusEnginePlugin * plugin, const lua_command_candidates_t * candidates, guint len);
+
+/**
+ * same as ibus_engine_plugin_fetch_candidates, on the worker thread of the plugin.
+ */
+void ibus_engine_plugin_fetch_candidates_async(IBusEnginePlugin * plugin, lua_command_candidates_t * candidates, guint len, GCancellable * cancellable, GAsyncReadyCallback callback, gpointer user_data);
+
+/**
+ * return the fetched candidates, or NULL if the results can't be fetched any more,
+ * or the fetch was cancelled.
+ */
+lua_command_candidates_t * ibus_engine_plugin_fetch_candidates_finish(IBusEnginePlugin * plugin, GAsyncResult * result);
+
+lua_command_candidates_t * ibus_engine_plugin_candidates_ref(lua_command_candidates_t * candidates);
+void ibus_engine_plugin_candidates_unref(lua_command_candidates_t * candidates);
+
+/**
+ * retrieve the bytes in use by the lua state.
+ */
+size_t ibus_engine_plugin_get_memory_usage(IBusEnginePlugin * plugin);
+
+/* receives the lua calls of the worker threads as complete events,
+   with times from g_get_monotonic_time, name is a string literal. */
+typedef void (* lua_plugin_trace_func_t)(const char * name, gint64 start, gint64 duration);
+
+/**
+ * trace the lua calls of all plugins on their worker threads with func,
+ * NULL stops tracing. set it before the first asynchronous call.
+ */
+void ibus_engine_plugin_set_trace_func(lua_plugin_trace_func_t func);
 #endif
@@ -0,0 +1,41 @@
+-- stops or restarts the collector.
+function test_gc(input)
+  collectgarbage(input)
+end
+
+-- returns n candidates, alternating contents and suggestions.
+function test_candidates(input)
+  local n = tonumber(input)
+  local result = {}
+  for i = 1, n do
+    if i % 2 == 1 then
+      result[i] = "candidate " .. i
+    else
+      result[i] = {suggest = "suggest " .. i, help = "help " .. i}
+    end
+  end
+  return result
+end
+
+-- returns n candidates lazily, as a (count, fetch) pair.
+function test_fetch(input)
+  return tonumber(input), function(i) return "candidate " .. i end
+end
+
+-- returns n candidates lazily, as an iterator.
+function test_iterator(input)
+  local n, i = tonumber(input), 0
+  return function()
+    i = i + 1
+    if i <= n then return "candidate " .. i end
+  end
+end
+
+-- returns n candidates lazily, as a coroutine.
+function test_coroutine(input)
+  return coroutine.create(function()
+    for i = 1, tonumber(input) do
+      coroutine.yield("candidate " .. i)
+    end
+  end)
+end
@@ -0,0 +1,198 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "lua-plugin.h"
+
+/* count heap allocations by interposing malloc, which also catches g_malloc. */
+#ifdef __GLIBC__
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t nmemb, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void __libc_free(void * ptr);
+
+static volatile gsize allocations = 0;
+static volatile gsize frees = 0;
+
+void * malloc(size_t size){
+  __sync_fetch_and_add(&allocations, 1);
+  return __libc_malloc(size);
+}
+
+void * calloc(size_t nmemb, size_t size){
+  __sync_fetch_and_add(&allocations, 1);
+  return __libc_calloc(nmemb, size);
+}
+
+void * realloc(void * ptr, size_t size){
+  if ( NULL == ptr )
+    __sync_fetch_and_add(&allocations, 1);
+  return __libc_realloc(ptr, size);
+}
+
+void free(void * ptr){
+  if ( ptr )
+    __sync_fetch_and_add(&frees, 1);
+  __libc_free(ptr);
+}
+
+#define COUNT_ALLOCATIONS 1
+#else
+static const gsize allocations = 0;
+static const gsize frees = 0;
+#endif
+
+#define ROWS 1000
+
+static void fetch_ready(GObject * source, GAsyncResult * result, gpointer user_data){
+  lua_command_candidates_t ** fetched = user_data;
+  *fetched = ibus_engine_plugin_fetch_candidates_finish
+    (IBUS_ENGINE_PLUGIN(source), result);
+  g_assert(NULL != *fetched);
+}
+
+/* lazy results are pulled as they are fetched. */
+static void test_lazy(IBusEnginePlugin * plugin, const char * lua_function_name){
+  lua_command_candidates_t * candidates, * fetched;
+  int i, num;
+
+  /* empty lazy results leave nothing on the lua stack. */
+  for ( i = 0; i < 100; ++i ){
+    num = ibus_engine_plugin_call(plugin, lua_function_name, "0");
+    g_assert(0 == num);
+  }
+
+  num = ibus_engine_plugin_call(plugin, lua_function_name, "3");
+  g_assert(3 == num);
+  candidates = ibus_engine_plugin_get_candidates(plugin);
+  g_assert(3 == candidates->len && !candidates->more);
+  ibus_engine_plugin_candidates_unref(candidates);
+
+  num = ibus_engine_plugin_call(plugin, lua_function_name, "100");
+  g_assert(0 < num && num < 100);
+  candidates = ibus_engine_plugin_get_candidates(plugin);
+  g_assert(candidates->more);
+
+  fetched = ibus_engine_plugin_fetch_candidates(plugin, candidates, 50);
+  g_assert(50 == fetched->len && fetched->more);
+  g_assert(0 == strcmp(fetched->candidates[49].content, "candidate 50"));
+  /* the previous candidates are shared, not marshalled again. */
+  g_assert(fetched->candidates[0].content == candidates->candidates[0].content);
+  ibus_engine_plugin_candidates_unref(candidates);
+  candidates = fetched;
+
+  fetched = NULL;
+  ibus_engine_plugin_fetch_candidates_async(plugin, candidates, 80, NULL,
+                                            fetch_ready, &fetched);
+  while ( NULL == fetched )
+    g_main_context_iteration(NULL, TRUE);
+  g_assert(80 == fetched->len && fetched->more);
+  g_assert(0 == strcmp(fetched->candidates[79].content, "candidate 80"));
+  ibus_engine_plugin_candidates_unref(candidates);
+  candidates = fetched;
+
+  fetched = ibus_engine_plugin_fetch_candidates(plugin, candidates, ROWS);
+  g_assert(100 == fetched->len && !fetched->more);
+  g_assert(0 == strcmp(fetched->candidates[99].content, "candidate 100"));
+  g_assert(NULL == ibus_engine_plugin_fetch_candidates(plugin, fetched, ROWS));
+  ibus_engine_plugin_candidates_unref(candidates);
+  ibus_engine_plugin_candidates_unref(fetched);
+}
+
+int main(int argc, char * argv[]){
+  IBusEnginePlugin * plugin;
+  lua_command_candidates_t * candidates;
+  lua_command_candidate_t * candidate;
+  gsize allocated, freed;
+  gchar * cache_home;
+  int i, num;
+
+  printf("starting test...\n");
+
+  /* keep the bytecode cache of the scripts out of the real home. */
+  cache_home = g_dir_make_tmp("test-lua-candidates-XXXXXX", NULL);
+  g_assert(cache_home);
+  g_setenv("XDG_CACHE_HOME", cache_home, TRUE);
+  g_free(cache_home);
+
+  g_type_init();
+
+  plugin = ibus_engine_plugin_new();
+  num = ibus_engine_plugin_load_lua_script
+    (plugin, LUASCRIPTDIR G_DIR_SEPARATOR_S "test-candidates.lua");
+  g_assert(0 == num);
+
+  for ( i = 0; i < 100; ++i ){
+    /* keep the collector from resizing the lua tables while counting. */
+    num = ibus_engine_plugin_call(plugin, "test_gc", "stop");
+    g_assert(0 == num);
+    num = ibus_engine_plugin_call(plugin, "test_candidates", G_STRINGIFY(ROWS));
+    g_assert(ROWS == num);
+
+    /* the candidates and all their strings are marshalled into two blocks. */
+    allocated = allocations;
+    candidates = ibus_engine_plugin_get_candidates(plugin);
+    allocated = allocations - allocated;
+    num = ibus_engine_plugin_call(plugin, "test_gc", "restart");
+    g_assert(0 == num);
+
+    g_assert(ROWS == candidates->len);
+    g_assert(0 == strcmp(candidates->candidates[0].content, "candidate 1"));
+    g_assert(NULL == candidates->candidates[0].suggest);
+    g_assert(0 == strcmp(candidates->candidates[1].suggest, "suggest 2"));
+    g_assert(0 == strcmp(candidates->candidates[1].help, "help 2"));
+    g_assert(0 == strcmp(candidates->candidates[ROWS - 1].help,
+                         "help " G_STRINGIFY(ROWS)));
+
+    freed = frees;
+    ibus_engine_plugin_candidates_unref(candidates);
+    freed = frees - freed;
+
+#ifdef COUNT_ALLOCATIONS
+    g_assert(2 == allocated);
+    g_assert(2 == freed);
+#endif
+  }
+
+  /* the copied retval is released completely. */
+  num = ibus_engine_plugin_call(plugin, "test_candidates", "1");
+  g_assert(1 == num);
+  allocated = allocations; freed = frees;
+  candidate = (lua_command_candidate_t *) ibus_engine_plugin_get_retval(plugin);
+  g_assert(0 == strcmp(candidate->content, "candidate 1"));
+  ibus_engine_plugin_free_candidate(candidate);
+#ifdef COUNT_ALLOCATIONS
+  g_assert(allocations - allocated == frees - freed);
+#endif
+
+  test_lazy(plugin, "test_fetch");
+  test_lazy(plugin, "test_iterator");
+  test_lazy(plugin, "test_coroutine");
+
+  g_object_unref(plugin);
+
+  printf("done.\n");
+  return 0;
+}
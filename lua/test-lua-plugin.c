@@ -26,8 +26,16 @@
 #include "lua-plugin.h"
 
 int main(int argc, char * argv[]){
+  gchar * cache_home;
+
   printf("starting test...\n");
 
+  /* keep the bytecode cache of the scripts out of the real home. */
+  cache_home = g_dir_make_tmp("test-lua-plugin-XXXXXX", NULL);
+  g_assert(cache_home);
+  g_setenv("XDG_CACHE_HOME", cache_home, TRUE);
+  g_free(cache_home);
+
   g_type_init();
   
   IBusEnginePlugin * plugin;
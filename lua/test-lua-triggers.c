@@ -0,0 +1,129 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "lua-plugin.h"
+
+static guint match(IBusEnginePlugin * plugin, lua_trigger_kind_t kind, const char * text, const lua_command_t ** triggers){
+  return ibus_engine_plugin_match_triggers(plugin, kind, text, triggers, 4);
+}
+
+static void trigger_ready(GObject * source, GAsyncResult * result, gpointer user_data){
+  lua_command_candidates_t ** candidates = user_data;
+  int num = ibus_engine_plugin_call_command_finish
+    (IBUS_ENGINE_PLUGIN(source), result, candidates);
+  g_assert(1 == num);
+}
+
+/* match and call the first trigger on the worker thread,
+   as the phonetic editors do for their input and commits. */
+static lua_command_candidates_t * call_trigger(IBusEnginePlugin * plugin, lua_trigger_kind_t kind, const char * text){
+  const lua_command_t * trigger = NULL;
+  lua_command_candidates_t * candidates = NULL;
+
+  if (!ibus_engine_plugin_match_triggers(plugin, kind, text, &trigger, 1))
+    return NULL;
+
+  ibus_engine_plugin_call_command_async(plugin, trigger, text, NULL,
+                                        trigger_ready, &candidates);
+  while (NULL == candidates)
+    g_main_context_iteration(NULL, TRUE);
+  return candidates;
+}
+
+int main(int argc, char * argv[]){
+  IBusEnginePlugin * plugin;
+  const lua_command_t * triggers[4];
+  const lua_command_candidate_t * candidate;
+  lua_command_candidates_t * candidates;
+  gchar * cache_home;
+  guint num;
+
+  printf("starting test...\n");
+
+  /* keep the bytecode cache of the scripts out of the real home. */
+  cache_home = g_dir_make_tmp("test-lua-triggers-XXXXXX", NULL);
+  g_assert(cache_home);
+  g_setenv("XDG_CACHE_HOME", cache_home, TRUE);
+  g_free(cache_home);
+
+  g_type_init();
+
+  plugin = ibus_engine_plugin_new();
+  g_assert(0 == match(plugin, LUA_TRIGGER_INPUT, "ushers", triggers));
+
+  num = ibus_engine_plugin_load_lua_script
+    (plugin, LUASCRIPTDIR G_DIR_SEPARATOR_S "test-triggers.lua");
+  g_assert(0 == num);
+
+  /* overlapping matches, in the order of their first match. */
+  num = match(plugin, LUA_TRIGGER_INPUT, "ushers", triggers);
+  g_assert(3 == num);
+  g_assert(0 == strcmp(triggers[0]->lua_function_name, "trigger_she"));
+  g_assert(0 == strcmp(triggers[1]->lua_function_name, "trigger_he"));
+  g_assert(0 == strcmp(triggers[2]->lua_function_name, "trigger_hers"));
+
+  /* each trigger is reported once. */
+  num = match(plugin, LUA_TRIGGER_INPUT, "hehehis", triggers);
+  g_assert(2 == num);
+  g_assert(0 == strcmp(triggers[0]->lua_function_name, "trigger_he"));
+  g_assert(0 == strcmp(triggers[1]->lua_function_name, "trigger_hers"));
+
+  g_assert(0 == match(plugin, LUA_TRIGGER_INPUT, "hxsxe", triggers));
+  g_assert(0 == match(plugin, LUA_TRIGGER_INPUT, "", triggers));
+  g_assert(1 == ibus_engine_plugin_match_triggers
+           (plugin, LUA_TRIGGER_INPUT, "ushers", triggers, 1));
+
+  /* the kinds are matched separately. */
+  g_assert(0 == match(plugin, LUA_TRIGGER_CANDIDATE, "ushers", triggers));
+  num = match(plugin, LUA_TRIGGER_CANDIDATE, "今天的日期", triggers);
+  g_assert(1 == num);
+  g_assert(0 == strcmp(triggers[0]->lua_function_name, "trigger_date"));
+
+  /* the matched triggers are called like commands. */
+  num = ibus_engine_plugin_call_command(plugin, triggers[0], "今天的日期");
+  g_assert(1 == num);
+  candidate = ibus_engine_plugin_get_retval(plugin);
+  g_assert(0 == strcmp(candidate->content, "date:今天的日期"));
+  ibus_engine_plugin_free_candidate((lua_command_candidate_t *) candidate);
+
+  /* both kinds run asynchronously outside the extension mode. */
+  candidates = call_trigger(plugin, LUA_TRIGGER_INPUT, "ushers");
+  g_assert(NULL != candidates && 1 == candidates->len);
+  g_assert(0 == strcmp(candidates->candidates[0].content, "she:ushers"));
+  ibus_engine_plugin_candidates_unref(candidates);
+
+  candidates = call_trigger(plugin, LUA_TRIGGER_CANDIDATE, "今天的日期");
+  g_assert(NULL != candidates && 1 == candidates->len);
+  g_assert(0 == strcmp(candidates->candidates[0].content, "date:今天的日期"));
+  ibus_engine_plugin_candidates_unref(candidates);
+
+  g_assert(NULL == call_trigger(plugin, LUA_TRIGGER_CANDIDATE, "ushers"));
+
+  g_object_unref(plugin);
+
+  printf("done.\n");
+  return 0;
+}
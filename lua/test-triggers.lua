@@ -0,0 +1,21 @@
+-- each trigger returns its name and the matched text.
+function trigger_he(input)
+  return "he:" .. input
+end
+
+function trigger_she(input)
+  return "she:" .. input
+end
+
+function trigger_hers(input)
+  return "hers:" .. input
+end
+
+function trigger_date(input)
+  return "date:" .. input
+end
+
+ime.register_trigger("trigger_he", "he", {"he"}, {})
+ime.register_trigger("trigger_she", "she", {"she"}, {})
+ime.register_trigger("trigger_hers", "hers", {"hers", "his"}, {})
+ime.register_trigger("trigger_date", "date", {}, {"日期", "时间"})
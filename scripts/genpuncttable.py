@@ -14,18 +14,24 @@ def gen_table():
     print 'static const gchar * const'
     print 'puncts[] = {'
     for k, vs in punct_map:
+        array.append((ord(k) if k else 0, i))
         k = tocstr(k)
         vs = map(tocstr, vs)
-        array.append((i, k))
         line = '    %s, %s, NULL,' % (k, ", ".join(vs))
         print line.encode("utf8")
         i += len(vs) + 2
     print '};'
     print
+    # direct-indexed by the ascii code of the key, the entry of
+    # code 0 is the candidate list shown right after the grave key.
+    index = dict(array)
     print 'static const gchar * const * const'
-    print 'punct_table[] = {'
-    for i, k in array:
-        print '    &puncts[%d],    // %s' % (i, k)
+    print 'punct_table[128] = {'
+    for c in range(128):
+        if c in index:
+            print '    &puncts[%d],    // %s' % (index[c], tocstr(unichr(c)) if c else '""')
+        else:
+            print '    NULL,           // 0x%02x' % c
     print '};'
 
 if __name__ == "__main__":
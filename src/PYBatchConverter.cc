@@ -0,0 +1,420 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PYBatchConverter.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <pinyin.h>
+#include "PYLibPinyin.h"
+
+namespace PY {
+
+/* same defaults as the engine config. */
+static const pinyin_option_t BATCH_PINYIN_OPTION =
+        PINYIN_INCOMPLETE |
+        ZHUYIN_INCOMPLETE |
+        PINYIN_CORRECT_ALL |
+        0;
+
+static const struct {
+    const gchar * const name;
+    BatchConverter::Scheme scheme;
+} batch_schemes [] = {
+    { "pinyin",        BatchConverter::SCHEME_FULL_PINYIN   },
+    { "double_pinyin", BatchConverter::SCHEME_DOUBLE_PINYIN },
+    { "bopomofo",      BatchConverter::SCHEME_BOPOMOFO      },
+};
+
+BatchConverter::BatchConverter (LibPinyinBackEnd & backend, Scheme scheme,
+                                guint nbest, const gchar *dictionaries)
+    : m_backend (backend),
+      m_scheme (scheme),
+      m_nbest (MAX (nbest, 1))
+{
+    std::string dicts = dictionaries ? dictionaries : "";
+
+    if (m_scheme == SCHEME_BOPOMOFO)
+        m_instance = m_backend.allocChewingInstance
+            (dicts, BATCH_PINYIN_OPTION, ZHUYIN_DEFAULT);
+    else
+        m_instance = m_backend.allocPinyinInstance
+            (dicts, BATCH_PINYIN_OPTION, DOUBLE_PINYIN_DEFAULT);
+}
+
+BatchConverter::~BatchConverter (void)
+{
+    if (m_scheme == SCHEME_BOPOMOFO)
+        m_backend.freeChewingInstance (m_instance);
+    else
+        m_backend.freePinyinInstance (m_instance);
+    m_instance = NULL;
+}
+
+gboolean
+BatchConverter::parseScheme (const gchar *name, Scheme & scheme)
+{
+    if (name == NULL) {
+        scheme = SCHEME_FULL_PINYIN;
+        return TRUE;
+    }
+
+    for (guint i = 0; i < G_N_ELEMENTS (batch_schemes); i++) {
+        if (strcmp (batch_schemes[i].name, name) == 0) {
+            scheme = batch_schemes[i].scheme;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+guint
+BatchConverter::convert (const gchar *input, String & output)
+{
+    pinyin_reset (m_instance);
+
+    switch (m_scheme) {
+    case SCHEME_FULL_PINYIN:
+        pinyin_parse_more_full_pinyins (m_instance, input);
+        break;
+    case SCHEME_DOUBLE_PINYIN:
+        pinyin_parse_more_double_pinyins (m_instance, input);
+        break;
+    case SCHEME_BOPOMOFO:
+        pinyin_parse_more_chewings (m_instance, input);
+        break;
+    }
+    pinyin_guess_sentence (m_instance);
+
+    guint i;
+    for (i = 0; i < m_nbest; i++) {
+        gchar *sentence = NULL;
+        if (!pinyin_get_sentence (m_instance, i, &sentence) || sentence == NULL)
+            break;
+
+        if (i)
+            output << '\t';
+        output << sentence;
+        g_free (sentence);
+    }
+    return i;
+}
+
+/* reads lines from a file, or from memory when benchmarking. */
+struct BatchInput {
+    FILE *file;
+    const std::vector<std::string> *lines;
+    gsize pos;
+    char *linebuf;
+    size_t size;
+
+    BatchInput (FILE *f)
+        : file (f), lines (NULL), pos (0), linebuf (NULL), size (0) { }
+    BatchInput (const std::vector<std::string> & l)
+        : file (NULL), lines (&l), pos (0), linebuf (NULL), size (0) { }
+    ~BatchInput (void) { free (linebuf); }
+
+    gboolean next (std::string & line)
+    {
+        if (lines) {
+            if (pos >= lines->size ())
+                return FALSE;
+            line = (*lines)[pos++];
+            return TRUE;
+        }
+
+        ssize_t read = getline (&linebuf, &size, file);
+        if (read == -1)
+            return FALSE;
+        while (read > 0 &&
+               (linebuf[read - 1] == '\n' || linebuf[read - 1] == '\r'))
+            linebuf[--read] = '\0';
+        line.assign (linebuf, read);
+        return TRUE;
+    }
+};
+
+/* one thread converts and writes line by line, as the input comes. */
+static guint
+batch_run_single (const BatchOptions & options,
+                  BatchConverter::Scheme scheme,
+                  BatchInput & input,
+                  FILE *output,
+                  gdouble & elapsed)
+{
+    LibPinyinBackEnd backend;
+    BatchConverter converter (backend, scheme,
+                              options.nbest, options.dictionaries);
+
+    GTimer *timer = g_timer_new ();
+    guint sentences = 0;
+    String result (256);
+    std::string line;
+
+    while (input.next (line)) {
+        result.clear ();
+        if (!line.empty ())
+            converter.convert (line.c_str (), result);
+        result << '\n';
+        if (output)
+            fwrite (result.c_str (), 1, result.size (), output);
+        sentences++;
+    }
+
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+    return sentences;
+}
+
+/* lines are converted in chunks, the input is read into a window of
+ * BATCH_WINDOW_CHUNKS chunks per thread, workers take the next chunk
+ * and the output is written and freed in input order. */
+#define BATCH_CHUNK_LINES 256
+#define BATCH_WINDOW_CHUNKS 2
+
+struct BatchChunk {
+    std::vector<std::string> lines;
+    String results;
+    gboolean done;
+};
+
+struct BatchJob {
+    const BatchOptions *options;
+    BatchConverter::Scheme scheme;
+    std::vector<BatchChunk> window;
+    guint n_read;               // chunks handed to the workers
+    guint next_chunk;           // next chunk to convert
+    gboolean eof;
+
+    GMutex lock;
+    GCond cond;
+    guint ready;
+    gboolean started;
+};
+
+static gpointer
+batch_worker (gpointer data)
+{
+    BatchJob *job = static_cast<BatchJob *> (data);
+
+    /* libpinyin contexts are not thread safe,
+     * so each worker loads its own context. */
+    LibPinyinBackEnd backend;
+    BatchConverter converter (backend, job->scheme,
+                              job->options->nbest,
+                              job->options->dictionaries);
+
+    g_mutex_lock (&job->lock);
+    job->ready++;
+    g_cond_broadcast (&job->cond);
+    while (!job->started)
+        g_cond_wait (&job->cond, &job->lock);
+
+    while (TRUE) {
+        while (job->next_chunk == job->n_read && !job->eof)
+            g_cond_wait (&job->cond, &job->lock);
+        if (job->next_chunk == job->n_read)
+            break;
+
+        guint n = job->next_chunk++;
+        BatchChunk & chunk = job->window[n % job->window.size ()];
+        g_mutex_unlock (&job->lock);
+
+        chunk.results.clear ();
+        for (guint i = 0; i < chunk.lines.size (); i++) {
+            const std::string & line = chunk.lines[i];
+            if (!line.empty ())
+                converter.convert (line.c_str (), chunk.results);
+            chunk.results << '\n';
+        }
+
+        g_mutex_lock (&job->lock);
+        chunk.done = TRUE;
+        g_cond_broadcast (&job->cond);
+    }
+    g_mutex_unlock (&job->lock);
+
+    return NULL;
+}
+
+/* returns the number of lines, elapsed is the seconds spent on
+ * converting, without loading contexts. */
+static guint
+batch_run (const BatchOptions & options,
+           BatchConverter::Scheme scheme,
+           BatchInput & input,
+           guint threads,
+           FILE *output,
+           gdouble & elapsed)
+{
+    if (threads <= 1)
+        return batch_run_single (options, scheme, input, output, elapsed);
+
+    BatchJob job;
+    job.options = &options;
+    job.scheme = scheme;
+    job.window.resize (threads * BATCH_WINDOW_CHUNKS);
+    job.n_read = 0;
+    job.next_chunk = 0;
+    job.eof = FALSE;
+    g_mutex_init (&job.lock);
+    g_cond_init (&job.cond);
+    job.ready = 0;
+    job.started = FALSE;
+
+    std::vector<GThread *> workers;
+    for (guint i = 0; i < threads; i++)
+        workers.push_back (g_thread_new ("batch", batch_worker, &job));
+
+    g_mutex_lock (&job.lock);
+    while (job.ready < threads)
+        g_cond_wait (&job.cond, &job.lock);
+    GTimer *timer = g_timer_new ();
+    job.started = TRUE;
+    g_cond_broadcast (&job.cond);
+
+    guint sentences = 0;
+    guint n_written = 0;
+    while (TRUE) {
+        /* fill the free slots of the window until the oldest chunk
+           is done, the workers only touch chunks below n_read. */
+        while (!job.eof && job.n_read - n_written < job.window.size () &&
+               !(n_written < job.n_read &&
+                 job.window[n_written % job.window.size ()].done)) {
+            BatchChunk & chunk = job.window[job.n_read % job.window.size ()];
+            g_mutex_unlock (&job.lock);
+
+            chunk.lines.clear ();
+            chunk.done = FALSE;
+            std::string line;
+            while (chunk.lines.size () < BATCH_CHUNK_LINES &&
+                   input.next (line))
+                chunk.lines.push_back (line);
+            gboolean eof = chunk.lines.size () < BATCH_CHUNK_LINES;
+
+            g_mutex_lock (&job.lock);
+            if (!chunk.lines.empty ()) {
+                sentences += chunk.lines.size ();
+                job.n_read++;
+            }
+            job.eof = eof;
+            g_cond_broadcast (&job.cond);
+        }
+
+        if (n_written == job.n_read)
+            break;
+
+        /* write the oldest chunk and free its slot. */
+        BatchChunk & chunk = job.window[n_written % job.window.size ()];
+        while (!chunk.done)
+            g_cond_wait (&job.cond, &job.lock);
+        g_mutex_unlock (&job.lock);
+
+        if (output) {
+            fwrite (chunk.results.c_str (), 1, chunk.results.size (), output);
+            fflush (output);
+        }
+        std::vector<std::string> ().swap (chunk.lines);
+        String ().swap (chunk.results);
+
+        g_mutex_lock (&job.lock);
+        n_written++;
+    }
+    job.eof = TRUE;
+    g_cond_broadcast (&job.cond);
+    g_mutex_unlock (&job.lock);
+
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    for (guint i = 0; i < workers.size (); i++)
+        g_thread_join (workers[i]);
+
+    g_mutex_clear (&job.lock);
+    g_cond_clear (&job.cond);
+    return sentences;
+}
+
+gint
+batch_convert (const BatchOptions & options)
+{
+    BatchConverter::Scheme scheme;
+    if (!BatchConverter::parseScheme (options.scheme, scheme)) {
+        g_printerr ("unknown scheme: %s\n", options.scheme);
+        return 1;
+    }
+
+    FILE *file = stdin;
+    if (options.input && strcmp (options.input, "-") != 0) {
+        file = fopen (options.input, "r");
+        if (file == NULL) {
+            g_printerr ("can not open %s.\n", options.input);
+            return 1;
+        }
+    }
+
+    guint threads = options.threads > 0 ?
+        options.threads : g_get_num_processors ();
+
+    if (options.benchmark) {
+        /* every run converts the same input, so keep it in memory. */
+        std::vector<std::string> lines;
+        {
+            BatchInput input (file);
+            std::string line;
+            while (input.next (line))
+                lines.push_back (line);
+        }
+        if (file != stdin)
+            fclose (file);
+
+        gdouble base = 0;
+        g_print ("threads\tseconds\tsentences/s\tspeedup\n");
+        for (guint n = 1; n <= threads; n++) {
+            BatchInput input (lines);
+            gdouble elapsed = 0;
+            batch_run (options, scheme, input, n, NULL, elapsed);
+            if (n == 1)
+                base = elapsed;
+            g_print ("%u\t%.3f\t%.1f\t%.2f\n", n, elapsed,
+                     elapsed > 0 ? lines.size () / elapsed : 0.0,
+                     elapsed > 0 ? base / elapsed : 0.0);
+        }
+        return 0;
+    }
+
+    BatchInput input (file);
+    gdouble elapsed = 0;
+    guint sentences = batch_run (options, scheme, input, threads,
+                                 stdout, elapsed);
+    if (file != stdin)
+        fclose (file);
+    fflush (stdout);
+
+    g_printerr ("converted %u sentences in %.3f seconds with %u threads, "
+                "%.1f sentences per second.\n",
+                sentences, elapsed, threads,
+                elapsed > 0 ? sentences / elapsed : 0.0);
+    return 0;
+}
+
+};
@@ -0,0 +1,74 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __PY_BATCH_CONVERTER_H_
+#define __PY_BATCH_CONVERTER_H_
+
+#include <glib.h>
+#include "PYString.h"
+
+typedef struct _pinyin_instance_t pinyin_instance_t;
+
+namespace PY {
+
+class LibPinyinBackEnd;
+
+/* converts lines of pinyin, double pinyin or bopomofo keys
+ * without ibus, see the --batch option. */
+class BatchConverter {
+public:
+    enum Scheme {
+        SCHEME_FULL_PINYIN = 0,
+        SCHEME_DOUBLE_PINYIN,
+        SCHEME_BOPOMOFO,
+    };
+
+    BatchConverter (LibPinyinBackEnd & backend, Scheme scheme,
+                    guint nbest, const gchar *dictionaries);
+    ~BatchConverter (void);
+
+    /* append the best sentences of input to output, separated by tabs. */
+    guint convert (const gchar *input, String & output);
+
+    static gboolean parseScheme (const gchar *name, Scheme & scheme);
+
+private:
+    LibPinyinBackEnd & m_backend;
+    pinyin_instance_t *m_instance;
+    Scheme m_scheme;
+    guint m_nbest;
+};
+
+struct BatchOptions {
+    const gchar *input;         // file name, NULL or "-" for stdin
+    const gchar *scheme;
+    gint nbest;
+    const gchar *dictionaries;
+    gint threads;               // worker threads, 0 for one per cpu
+    gboolean benchmark;         // measure scaling from 1 to threads
+};
+
+/* run the batch mode, returns the exit status. */
+gint batch_convert (const BatchOptions & options);
+
+};
+
+#endif
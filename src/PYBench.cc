@@ -0,0 +1,530 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Microbenchmarks of the self-contained kernels, see "make bench".
+ * Prints ns/op and heap allocations/op, or JSON with --json. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#include <ibus.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#include <string>
+#include <vector>
+#include "PYBus.h"
+#include "PYString.h"
+#include "PYPConfig.h"
+#include "PYPinyinProperties.h"
+#include "PYSimpTradConverter.h"
+#include "PYHalfFullConverter.h"
+#include "PYPunctEditor.h"
+#ifdef IBUS_BUILD_LUA_EXTENSION
+extern "C" {
+#include "lua-plugin.h"
+}
+#include "PYExtEditor.h"
+#endif
+#ifdef IBUS_BUILD_ENGLISH_INPUT_MODE
+#include "PYEnglishDatabase.h"
+#endif
+#ifdef IBUS_BUILD_STROKE_INPUT_MODE
+#include "PYStrokeDatabase.h"
+#endif
+
+using namespace PY;
+
+/* each kernel runs at least this long, in microseconds. */
+#define BENCH_MIN_TIME (100 * 1000)
+
+/* count heap allocations by interposing malloc and the aligned
+ * allocators, which also catches operator new and g_malloc. */
+#ifdef __GLIBC__
+extern "C" {
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t nmemb, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+}
+
+static volatile gsize bench_allocations = 0;
+
+extern "C" void *
+malloc (size_t size)
+{
+    __sync_fetch_and_add (&bench_allocations, 1);
+    return __libc_malloc (size);
+}
+
+extern "C" void *
+calloc (size_t nmemb, size_t size)
+{
+    __sync_fetch_and_add (&bench_allocations, 1);
+    return __libc_calloc (nmemb, size);
+}
+
+extern "C" void *
+realloc (void *ptr, size_t size)
+{
+    __sync_fetch_and_add (&bench_allocations, 1);
+    return __libc_realloc (ptr, size);
+}
+
+extern "C" void *
+memalign (size_t alignment, size_t size)
+{
+    __sync_fetch_and_add (&bench_allocations, 1);
+    return __libc_memalign (alignment, size);
+}
+
+extern "C" void *
+aligned_alloc (size_t alignment, size_t size)
+{
+    __sync_fetch_and_add (&bench_allocations, 1);
+    return __libc_memalign (alignment, size);
+}
+
+extern "C" int
+posix_memalign (void **memptr, size_t alignment, size_t size)
+{
+    if (alignment % sizeof (void *) != 0 ||
+        (alignment & (alignment - 1)) != 0)
+        return EINVAL;
+
+    __sync_fetch_and_add (&bench_allocations, 1);
+    void *ptr = __libc_memalign (alignment, size);
+    if (ptr == NULL)
+        return ENOMEM;
+    *memptr = ptr;
+    return 0;
+}
+
+#define BENCH_COUNT_ALLOCATIONS 1
+#else
+static const gsize bench_allocations = 0;
+#endif
+
+struct BenchResult {
+    std::string name;
+    gdouble ns_per_op;
+    gdouble allocs_per_op;
+};
+
+static std::vector<BenchResult> bench_results;
+static gchar *bench_filter = NULL;
+static gboolean bench_json = FALSE;
+
+static const GOptionEntry entries[] =
+{
+    { "json",   0, 0, G_OPTION_ARG_NONE, &bench_json,
+        "print the results as JSON", NULL },
+    { "filter", 0, 0, G_OPTION_ARG_STRING, &bench_filter,
+        "only run the kernels containing NAME", "NAME" },
+    { NULL },
+};
+
+/* kernel () does ops operations per call. */
+template <typename Kernel>
+static void
+bench_run (const gchar *name, guint ops, Kernel kernel)
+{
+    if (bench_filter && strstr (name, bench_filter) == NULL)
+        return;
+
+    /* warm up the caches, then double the iterations
+     * until one run is long enough. */
+    kernel ();
+
+    guint64 iterations = 1;
+    gint64 elapsed;
+    gsize allocations;
+    while (TRUE) {
+        allocations = bench_allocations;
+        gint64 start = g_get_monotonic_time ();
+        for (guint64 i = 0; i < iterations; i++)
+            kernel ();
+        elapsed = g_get_monotonic_time () - start;
+        allocations = bench_allocations - allocations;
+
+        if (elapsed >= BENCH_MIN_TIME)
+            break;
+        iterations *= 2;
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.ns_per_op = elapsed * 1000.0 / (iterations * ops);
+#ifdef BENCH_COUNT_ALLOCATIONS
+    result.allocs_per_op = (gdouble) allocations / (iterations * ops);
+#else
+    result.allocs_per_op = -1;
+#endif
+    bench_results.push_back (result);
+
+    if (!bench_json)
+        g_print ("%-56s %12.1f %12.2f\n", name,
+                 result.ns_per_op, result.allocs_per_op);
+}
+
+static void
+bench_skip (const gchar *name, const gchar *reason)
+{
+    if (bench_filter && strstr (name, bench_filter) == NULL)
+        return;
+    if (!bench_json)
+        g_print ("%-56s skipped, %s\n", name, reason);
+}
+
+static const gchar * const simp_sentences[] = {
+    "我们今天在图书馆里学习了很长时间",
+    "这个输入法的词库已经更新到最新版本了",
+    "请问从这里到火车站应该怎么走",
+    "随着经济的发展，人们的生活水平不断提高。",
+};
+
+static const gchar * const ascii_sentence =
+    "Hello, World! The quick brown fox jumps over the lazy dog 1234567890.";
+
+static void
+bench_converters (void)
+{
+    String output (256);
+
+#ifdef HAVE_OPENCC
+    const gchar *simp_trad = "SimpTradConverter::simpToTrad (opencc)";
+#else
+    const gchar *simp_trad = "SimpTradConverter::simpToTrad (builtin)";
+#endif
+    bench_run (simp_trad, G_N_ELEMENTS (simp_sentences), [&] () {
+        for (guint i = 0; i < G_N_ELEMENTS (simp_sentences); i++) {
+            output.clear ();
+            SimpTradConverter::simpToTrad (simp_sentences[i], output);
+        }
+    });
+
+    std::vector<gunichar> half, full;
+    for (const gchar *p = ascii_sentence; *p; p++) {
+        half.push_back (*p);
+        full.push_back (HalfFullConverter::toFull (*p));
+    }
+
+    volatile gunichar sink = 0;
+    bench_run ("HalfFullConverter::toFull", half.size (), [&] () {
+        for (guint i = 0; i < half.size (); i++)
+            sink = HalfFullConverter::toFull (half[i]);
+    });
+    bench_run ("HalfFullConverter::toHalf", full.size (), [&] () {
+        for (guint i = 0; i < full.size (); i++)
+            sink = HalfFullConverter::toHalf (full[i]);
+    });
+
+    String full_sentence;
+    HalfFullConverter::toFull (ascii_sentence, full_sentence);
+
+    bench_run ("HalfFullConverter::toFull (string)", half.size (), [&] () {
+        output.clear ();
+        HalfFullConverter::toFull (ascii_sentence, output);
+    });
+    bench_run ("HalfFullConverter::toHalf (string)", full.size (), [&] () {
+        output.clear ();
+        HalfFullConverter::toHalf (full_sentence, output);
+    });
+}
+
+static void
+bench_string (void)
+{
+    String output (256);
+
+    bench_run ("String::printf (sql)", 1, [&] () {
+        output.printf ("SELECT word FROM english WHERE word LIKE \"%s%%\" "
+                       "GROUP BY word ORDER BY SUM(freq) DESC;", "inter");
+    });
+    bench_run ("String::operator<< (guint)", 10, [&] () {
+        output.clear ();
+        for (guint i = 0; i < 10; i++)
+            output << i * 1234567u;
+    });
+
+    std::vector<gunichar> full;
+    for (const gchar *p = ascii_sentence; *p; p++)
+        full.push_back (HalfFullConverter::toFull (*p));
+
+    /* the full width commit of the pinyin editors. */
+    bench_run ("String::appendUnichar", full.size (), [&] () {
+        output.clear ();
+        for (guint i = 0; i < full.size (); i++)
+            output.appendUnichar (full[i]);
+    });
+}
+
+static const gint64 numbers[] = {
+    0, 7, 10, 105, 2014, 30008, 1234567890, 100000001,
+};
+
+static void
+bench_numbers (void)
+{
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    std::string output;
+
+    bench_run ("simplest_cn_number", G_N_ELEMENTS (numbers), [&] () {
+        for (guint i = 0; i < G_N_ELEMENTS (numbers); i++)
+            output = simplest_cn_number (numbers[i]);
+    });
+    bench_run ("simplified_number", G_N_ELEMENTS (numbers), [&] () {
+        for (guint i = 0; i < G_N_ELEMENTS (numbers); i++)
+            output = simplified_number (numbers[i]);
+    });
+    bench_run ("traditional_number", G_N_ELEMENTS (numbers), [&] () {
+        for (guint i = 0; i < G_N_ELEMENTS (numbers); i++)
+            output = traditional_number (numbers[i]);
+    });
+#else
+    bench_skip ("simplified_number", "built without lua extension");
+#endif
+}
+
+/* remove the files in path, the directories are kept. */
+static void
+bench_clear_dir (const gchar *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    if (dir == NULL)
+        return;
+
+    const gchar *name;
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        gchar *file = g_build_filename (path, name, NULL);
+        g_unlink (file);
+        g_free (file);
+    }
+    g_dir_close (dir);
+}
+
+static void
+bench_lua (void)
+{
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    const gchar *base = ".." G_DIR_SEPARATOR_S "lua" G_DIR_SEPARATOR_S "base.lua";
+    IBusEnginePlugin *plugin = ibus_engine_plugin_new ();
+    if (ibus_engine_plugin_load_lua_script (plugin, base)) {
+        base = PKGDATADIR G_DIR_SEPARATOR_S "base.lua";
+        if (ibus_engine_plugin_load_lua_script (plugin, base)) {
+            bench_skip ("ibus_engine_plugin_call", "base.lua not found");
+            g_object_unref (plugin);
+            return;
+        }
+    }
+
+    /* the first load above has filled the bytecode cache. */
+    bench_run ("ibus_engine_plugin_load_lua_script (base.lua, cached)", 1, [&] () {
+        IBusEnginePlugin *startup = ibus_engine_plugin_new ();
+        ibus_engine_plugin_load_lua_script (startup, base);
+        g_object_unref (startup);
+    });
+
+    /* the same load compiling base.lua, to compare with the cache. */
+    gchar *cache = g_build_filename (g_get_user_cache_dir (),
+                                     "ibus", "libpinyin", "lua", NULL);
+    bench_run ("ibus_engine_plugin_load_lua_script (base.lua, compiled)", 1, [&] () {
+        bench_clear_dir (cache);
+        IBusEnginePlugin *startup = ibus_engine_plugin_new ();
+        ibus_engine_plugin_load_lua_script (startup, base);
+        g_object_unref (startup);
+    });
+    g_free (cache);
+
+    bench_run ("ibus_engine_plugin_call (compute)", 1, [&] () {
+        if (ibus_engine_plugin_call (plugin, "compute", "1+2*3") == 1) {
+            lua_command_candidates_t *candidates =
+                ibus_engine_plugin_get_candidates (plugin);
+            ibus_engine_plugin_candidates_unref (candidates);
+        }
+    });
+
+    g_object_unref (plugin);
+#else
+    bench_skip ("ibus_engine_plugin_call", "built without lua extension");
+#endif
+}
+
+static void
+bench_databases (void)
+{
+#ifdef IBUS_BUILD_ENGLISH_INPUT_MODE
+    {
+        static const gchar * const prefixes[] = { "a", "the", "comp", "inter", "x" };
+        std::vector<std::string> words;
+
+        /* the user database goes to a private directory,
+           removed again after the run. */
+        gchar *tmpdir = g_build_filename (g_get_tmp_dir (),
+                                          "ibus-libpinyin-bench-XXXXXX",
+                                          NULL);
+        if (g_mkdtemp (tmpdir) != NULL) {
+            gchar *user_db = g_build_filename (tmpdir, "english.db", NULL);
+            {
+                EnglishDatabase database;
+                if (database.openDatabase
+                        (".." G_DIR_SEPARATOR_S "data" G_DIR_SEPARATOR_S "english.db",
+                         user_db) ||
+                    database.openDatabase
+                        (PKGDATADIR G_DIR_SEPARATOR_S "db" G_DIR_SEPARATOR_S "english.db",
+                         user_db)) {
+                    bench_run ("EnglishDatabase::listWords", G_N_ELEMENTS (prefixes), [&] () {
+                        for (guint i = 0; i < G_N_ELEMENTS (prefixes); i++)
+                            database.listWords (prefixes[i], words);
+                    });
+                } else {
+                    bench_skip ("EnglishDatabase::listWords", "english.db not found");
+                }
+            }
+            g_unlink (user_db);
+            g_rmdir (tmpdir);
+            g_free (user_db);
+        } else {
+            bench_skip ("EnglishDatabase::listWords", "can not create a temporary directory");
+        }
+        g_free (tmpdir);
+    }
+#else
+    bench_skip ("EnglishDatabase::listWords", "built without english mode");
+#endif
+
+#ifdef IBUS_BUILD_STROKE_INPUT_MODE
+    {
+        static const gchar * const prefixes[] = { "1", "12", "2534", "44" };
+        std::vector<std::string> characters;
+        StrokeDatabase database;
+
+        if (database.openDatabase
+                (".." G_DIR_SEPARATOR_S "data" G_DIR_SEPARATOR_S "strokes.db") ||
+            database.openDatabase
+                (PKGDATADIR G_DIR_SEPARATOR_S "db" G_DIR_SEPARATOR_S "strokes.db")) {
+            bench_run ("StrokeDatabase::listCharacters", G_N_ELEMENTS (prefixes), [&] () {
+                for (guint i = 0; i < G_N_ELEMENTS (prefixes); i++)
+                    database.listCharacters (prefixes[i], characters);
+            });
+        } else {
+            bench_skip ("StrokeDatabase::listCharacters", "strokes.db not found");
+        }
+    }
+#else
+    bench_skip ("StrokeDatabase::listCharacters", "built without stroke mode");
+#endif
+}
+
+/* the editors need the ibus config for their properties. */
+static void
+bench_editors (void)
+{
+    static const gchar puncts[] = ",.;:?!\"'()[]<>`~@#$%^&*-_+=\\/|{}";
+
+    ibus_init ();
+    Bus bus;
+    if (!bus.isConnected () || !ibus_bus_get_config (bus)) {
+        bench_skip ("PunctEditor::updatePunctCandidates", "no ibus");
+        return;
+    }
+
+    PinyinConfig::init (bus);
+    PinyinProperties props (PinyinConfig::instance ());
+    PunctEditor editor (props, PinyinConfig::instance ());
+
+    bench_run ("PunctEditor::updatePunctCandidates", sizeof (puncts) - 1, [&] () {
+        for (const gchar *p = puncts; *p; p++)
+            editor.updatePunctCandidates (*p);
+    });
+}
+
+static void
+bench_print_json (void)
+{
+    g_print ("[\n");
+    for (guint i = 0; i < bench_results.size (); i++) {
+        const BenchResult & result = bench_results[i];
+        g_print ("  {\"name\": \"%s\", \"ns_per_op\": %.1f, "
+                 "\"allocs_per_op\": %.2f}%s\n",
+                 result.name.c_str (), result.ns_per_op,
+                 result.allocs_per_op,
+                 i + 1 < bench_results.size () ? "," : "");
+    }
+    g_print ("]\n");
+}
+
+int
+main (gint argc, gchar **argv)
+{
+    GError *error = NULL;
+    GOptionContext *context;
+
+    setlocale (LC_ALL, "");
+
+    context = g_option_context_new ("- ibus-libpinyin microbenchmarks");
+    g_option_context_add_main_entries (context, entries, "ibus-libpinyin");
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_print ("Option parsing failed: %s\n", error->message);
+        exit (-1);
+    }
+
+    /* the kernels fill and clear the lua bytecode cache, keep it
+       in a private directory, removed again after the run. */
+    gchar *cache_home = g_build_filename (g_get_tmp_dir (),
+                                          "ibus-libpinyin-bench-XXXXXX",
+                                          NULL);
+    if (g_mkdtemp (cache_home) == NULL) {
+        g_print ("Can not create a temporary directory\n");
+        exit (-1);
+    }
+    g_setenv ("XDG_CACHE_HOME", cache_home, TRUE);
+
+    if (!bench_json)
+        g_print ("%-56s %12s %12s\n", "kernel", "ns/op", "allocs/op");
+
+    bench_string ();
+    bench_converters ();
+    bench_numbers ();
+    bench_lua ();
+    bench_databases ();
+    bench_editors ();
+
+    if (bench_json)
+        bench_print_json ();
+
+    /* the cache directory of the lua plugin, then its parents. */
+    gchar *dir = g_build_filename (cache_home, "ibus", "libpinyin", "lua", NULL);
+    bench_clear_dir (dir);
+    while (strcmp (dir, cache_home) != 0) {
+        g_rmdir (dir);
+        gchar *parent = g_path_get_dirname (dir);
+        g_free (dir);
+        dir = parent;
+    }
+    g_free (dir);
+    g_rmdir (cache_home);
+    g_free (cache_home);
+    return 0;
+}
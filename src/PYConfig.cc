@@ -20,6 +20,7 @@
  */
 #include "PYConfig.h"
 
+#include <string.h>
 #include "PYTypes.h"
 #include "PYBus.h"
 
@@ -37,6 +38,14 @@ Config::Config (Bus & bus, const std::string & name)
                       this);
 }
 
+/* a floating placeholder, as there is no IBusConfig to wrap. */
+Config::Config (const std::string & name)
+    : Object (g_object_new (G_TYPE_INITIALLY_UNOWNED, NULL)),
+      m_section ("engine/" + name)
+{
+    initDefaultValues ();
+}
+
 Config::~Config (void)
 {
 }
@@ -52,6 +61,7 @@ Config::initDefaultValues (void)
     m_minus_equal_page = TRUE;
     m_comma_period_page = TRUE;
     m_auto_commit = FALSE;
+    m_streaming_commit_length = 0;
 
     m_double_pinyin = FALSE;
     m_double_pinyin_schema = DOUBLE_PINYIN_DEFAULT;
@@ -65,13 +75,136 @@ Config::initDefaultValues (void)
 
     m_dictionaries = "";
 
+    m_editor_idle_timeout = 600;
+    parseContentTypePolicy (CONTENT_TYPE_POLICY_DEFAULT);
+
     m_main_switch = "<Shift>";
     m_letter_switch = "";
     m_punct_switch = "<Control>period";
     m_trad_switch = "<Control><Shift>f";
+    parseAccelerators ();
+}
+
+static const struct {
+    const gchar * const name;
+    guint mask;
+} accelerator_modifiers [] = {
+    { "<Control>", IBUS_CONTROL_MASK },
+    { "<Alt>",     IBUS_MOD1_MASK    },
+    { "<Shift>",   IBUS_SHIFT_MASK   },
+    { "<Meta>",    IBUS_META_MASK    },
+    { "<Super>",   IBUS_SUPER_MASK   },
+    { "<Hyper>",   IBUS_HYPER_MASK   },
+};
+
+static void
+parse_accelerator (const std::string & name, Accelerator & accel)
+{
+    const gchar *p = name.c_str ();
+
+    accel.keyval = 0;
+    accel.modifiers = 0;
+
+    while (*p == '<') {
+        guint i;
+        for (i = 0; i < G_N_ELEMENTS (accelerator_modifiers); i++) {
+            gsize len = strlen (accelerator_modifiers[i].name);
+            if (strncmp (p, accelerator_modifiers[i].name, len) == 0) {
+                accel.modifiers |= accelerator_modifiers[i].mask;
+                p += len;
+                break;
+            }
+        }
+        /* unknown modifier, never match. */
+        if (i == G_N_ELEMENTS (accelerator_modifiers))
+            goto invalid;
+    }
+
+    if (*p) {
+        accel.keyval = ibus_keyval_from_name (p);
+        if (accel.keyval == IBUS_VoidSymbol)
+            goto invalid;
+        accel.keyval = ibus_keyval_to_lower (accel.keyval);
+    }
+    return;
+
+invalid:
+    accel.keyval = 0;
+    accel.modifiers = 0;
+}
+
+void
+Config::parseAccelerators (void)
+{
+    parse_accelerator (m_main_switch, m_main_switch_accel);
+    parse_accelerator (m_letter_switch, m_letter_switch_accel);
+    parse_accelerator (m_punct_switch, m_punct_switch_accel);
+    parse_accelerator (m_trad_switch, m_trad_switch_accel);
 }
 
 
+#if IBUS_CHECK_VERSION (1, 5, 4)
+static const struct {
+    const gchar * const name;
+    guint purpose;
+} input_purposes [] = {
+    { "free_form", IBUS_INPUT_PURPOSE_FREE_FORM },
+    { "alpha",     IBUS_INPUT_PURPOSE_ALPHA     },
+    { "digits",    IBUS_INPUT_PURPOSE_DIGITS    },
+    { "number",    IBUS_INPUT_PURPOSE_NUMBER    },
+    { "phone",     IBUS_INPUT_PURPOSE_PHONE     },
+    { "url",       IBUS_INPUT_PURPOSE_URL       },
+    { "email",     IBUS_INPUT_PURPOSE_EMAIL     },
+    { "name",      IBUS_INPUT_PURPOSE_NAME      },
+    { "pin",       IBUS_INPUT_PURPOSE_PIN       },
+#if IBUS_CHECK_VERSION (1, 5, 24)
+    { "terminal",  IBUS_INPUT_PURPOSE_TERMINAL  },
+#endif
+};
+#endif
+
+static const struct {
+    const gchar * const name;
+    ContentTypePolicy policy;
+} content_type_policies [] = {
+    { "normal",      CONTENT_TYPE_POLICY_NORMAL      },
+    { "passthrough", CONTENT_TYPE_POLICY_PASSTHROUGH },
+    { "fallback",    CONTENT_TYPE_POLICY_FALLBACK    },
+    { "english",     CONTENT_TYPE_POLICY_ENGLISH     },
+};
+
+void
+Config::parseContentTypePolicy (const std::string & policy)
+{
+    for (guint i = 0; i < MAX_INPUT_PURPOSE; i++)
+        m_content_type_policy[i] = CONTENT_TYPE_POLICY_NORMAL;
+
+#if IBUS_CHECK_VERSION (1, 5, 4)
+    gchar ** items = g_strsplit (policy.c_str (), ";", -1);
+    for (gchar ** item = items; *item; item++) {
+        gchar ** pair = g_strsplit (*item, ":", 2);
+        if (g_strv_length (pair) != 2) {
+            g_strfreev (pair);
+            continue;
+        }
+
+        gchar * purpose_name = g_strstrip (pair[0]);
+        gchar * policy_name = g_strstrip (pair[1]);
+        for (guint i = 0; i < G_N_ELEMENTS (input_purposes); i++) {
+            if (strcmp (input_purposes[i].name, purpose_name) != 0)
+                continue;
+            for (guint j = 0; j < G_N_ELEMENTS (content_type_policies); j++) {
+                if (strcmp (content_type_policies[j].name, policy_name) == 0)
+                    m_content_type_policy[input_purposes[i].purpose] =
+                        content_type_policies[j].policy;
+            }
+        }
+        g_strfreev (pair);
+    }
+    g_strfreev (items);
+#endif
+}
+
 void
 Config::readDefaultValues (void)
 {
@@ -35,9 +35,40 @@ namespace PY {
 
 class Bus;
 
+/* accelerator parsed from a name like "<Control><Shift>f",
+ * in the form built by pinyin_accelerator_name. */
+struct Accelerator {
+    guint keyval;
+    guint modifiers;
+
+    /* keyval and modifiers are normalized by pinyin_accelerator_normalize. */
+    gboolean match (guint key, guint mask) const
+    {
+        return (keyval != 0 || modifiers != 0) &&
+               keyval == key && modifiers == mask;
+    }
+};
+
+/* how key events are handled in fields of some input purpose. */
+enum ContentTypePolicy {
+    CONTENT_TYPE_POLICY_NORMAL = 0,     // full processing
+    CONTENT_TYPE_POLICY_PASSTHROUGH,    // leave keys to the application
+    CONTENT_TYPE_POLICY_FALLBACK,       // only run the fallback editor
+    CONTENT_TYPE_POLICY_ENGLISH,        // start in english mode
+};
+
+#define MAX_INPUT_PURPOSE 16
+
+/* "<purpose>:<policy>" pairs, separated by ';'. */
+#define CONTENT_TYPE_POLICY_DEFAULT \
+    "url:english;email:english;digits:passthrough;number:passthrough;" \
+    "phone:passthrough;pin:passthrough"
+
 class Config : public Object {
 protected:
     Config (Bus & bus, const std::string & name);
+    /* without ibus, the values keep their defaults, e.g. in tests. */
+    explicit Config (const std::string & name);
     virtual ~Config (void);
 
 public:
@@ -50,6 +81,7 @@ public:
     gboolean minusEqualPage (void) const        { return m_minus_equal_page; }
     gboolean commaPeriodPage (void) const       { return m_comma_period_page; }
     gboolean autoCommit (void) const            { return m_auto_commit; }
+    guint streamingCommitLength (void) const    { return m_streaming_commit_length; }
     gboolean doublePinyin (void) const          { return m_double_pinyin; }
     DoublePinyinScheme doublePinyinSchema (void) const { return m_double_pinyin_schema; }
     gboolean doublePinyinShowRaw (void) const   { return m_double_pinyin_show_raw; }
@@ -64,17 +96,31 @@ public:
     gboolean auxiliarySelectKeyF (void) const   { return m_auxiliary_select_key_f; }
     gboolean auxiliarySelectKeyKP (void) const  { return m_auxiliary_select_key_kp; }
     gboolean enterKey (void) const  { return m_enter_key; }
-
-    std::string mainSwitch (void) const         { return m_main_switch; }
-    std::string letterSwitch (void) const       { return m_letter_switch; }
-    std::string punctSwitch (void) const        { return m_punct_switch; }
-    std::string tradSwitch (void) const         { return m_trad_switch; }
+    guint editorIdleTimeout (void) const        { return m_editor_idle_timeout; }
+    ContentTypePolicy contentTypePolicy (guint purpose) const
+    {
+        if (purpose >= MAX_INPUT_PURPOSE)
+            return CONTENT_TYPE_POLICY_NORMAL;
+        return m_content_type_policy[purpose];
+    }
+
+    const std::string & mainSwitch (void) const     { return m_main_switch; }
+    const std::string & letterSwitch (void) const   { return m_letter_switch; }
+    const std::string & punctSwitch (void) const    { return m_punct_switch; }
+    const std::string & tradSwitch (void) const     { return m_trad_switch; }
+
+    const Accelerator & mainSwitchAccel (void) const    { return m_main_switch_accel; }
+    const Accelerator & letterSwitchAccel (void) const  { return m_letter_switch_accel; }
+    const Accelerator & punctSwitchAccel (void) const   { return m_punct_switch_accel; }
+    const Accelerator & tradSwitchAccel (void) const    { return m_trad_switch_accel; }
 
 protected:
     bool read (const gchar * name, bool defval);
     gint read (const gchar * name, gint defval);
     std::string read (const gchar * name, const gchar * defval);
     void initDefaultValues (void);
+    void parseAccelerators (void);
+    void parseContentTypePolicy (const std::string & policy);
 
     virtual void readDefaultValues (void);
     virtual gboolean valueChanged (const std::string  &section,
@@ -101,6 +147,8 @@ protected:
     gboolean m_minus_equal_page;
     gboolean m_comma_period_page;
     gboolean m_auto_commit;
+    /* commit the stable head of longer inputs, 0 disables it. */
+    guint m_streaming_commit_length;
 
     gboolean m_double_pinyin;
     DoublePinyinScheme m_double_pinyin_schema;
@@ -120,11 +168,18 @@ protected:
 
     gboolean m_enter_key;
 
+    guint m_editor_idle_timeout;
+    ContentTypePolicy m_content_type_policy[MAX_INPUT_PURPOSE];
+
     std::string m_main_switch;
     std::string m_letter_switch;
     std::string m_punct_switch;
     std::string m_trad_switch;
 
+    Accelerator m_main_switch_accel;
+    Accelerator m_letter_switch_accel;
+    Accelerator m_punct_switch_accel;
+    Accelerator m_trad_switch_accel;
 };
 
 
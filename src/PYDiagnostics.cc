@@ -0,0 +1,150 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PYDiagnostics.h"
+
+#include <stdio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <glib-unix.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
+
+namespace PY {
+
+gint Diagnostics::m_counts[DIAG_LAST];
+std::map<guint, Diagnostics::Reporter> Diagnostics::m_reporters;
+guint Diagnostics::m_last_id = 0;
+
+static const gchar * const object_names[DIAG_LAST] = {
+    "engines",
+    "editors",
+    "pinyin contexts",
+    "pinyin instances",
+    "sqlite handles",
+    "lua states",
+};
+
+guint
+Diagnostics::addReporter (const Reporter & reporter)
+{
+    m_reporters[++m_last_id] = reporter;
+    return m_last_id;
+}
+
+void
+Diagnostics::removeReporter (guint id)
+{
+    m_reporters.erase (id);
+}
+
+gsize
+Diagnostics::directorySize (const gchar *path)
+{
+    GDir *dir = g_dir_open (path, 0, NULL);
+    if (dir == NULL)
+        return 0;
+
+    gsize size = 0;
+    const gchar *name;
+    while ((name = g_dir_read_name (dir)) != NULL) {
+        gchar *filename = g_build_filename (path, name, NULL);
+        GStatBuf buf;
+        if (g_stat (filename, &buf) == 0 && S_ISREG (buf.st_mode))
+            size += buf.st_size;
+        g_free (filename);
+    }
+    g_dir_close (dir);
+    return size;
+}
+
+/* resident set size from /proc, zero when not available. */
+static gsize
+resident_size (void)
+{
+    FILE *statm = fopen ("/proc/self/statm", "r");
+    if (statm == NULL)
+        return 0;
+
+    unsigned long total = 0, resident = 0;
+    if (fscanf (statm, "%lu %lu", &total, &resident) != 2)
+        resident = 0;
+    fclose (statm);
+    return resident * sysconf (_SC_PAGESIZE);
+}
+
+void
+Diagnostics::report (String & output)
+{
+    sqlite3_int64 sqlite_used = sqlite3_memory_used ();
+    sqlite3_int64 sqlite_peak = sqlite3_memory_highwater (FALSE);
+
+    output.appendPrintf ("ibus-libpinyin diagnostics, pid %d\n", getpid ());
+    output.appendPrintf ("resident: %" G_GSIZE_FORMAT " KiB\n",
+                         resident_size () / 1024);
+    output.appendPrintf ("sqlite: %lld KiB used, %lld KiB peak\n",
+                         (long long) sqlite_used / 1024,
+                         (long long) sqlite_peak / 1024);
+
+    output << "objects:";
+    for (guint i = 0; i < DIAG_LAST; i++)
+        output.appendPrintf (" %s %d%s", object_names[i],
+                             g_atomic_int_get (&m_counts[i]),
+                             i + 1 < DIAG_LAST ? "," : "\n");
+
+    std::map<guint, Reporter>::iterator it;
+    for (it = m_reporters.begin (); it != m_reporters.end (); it++)
+        it->second (output);
+}
+
+void
+Diagnostics::dump (void)
+{
+    String output (1024);
+    report (output);
+
+    g_printerr ("%s", output.c_str ());
+
+    gchar *path = g_build_filename (g_get_user_cache_dir (),
+                                    "ibus", "libpinyin", NULL);
+    g_mkdir_with_parents (path, 0700);
+    gchar *filename = g_build_filename (path, "diagnostics.txt", NULL);
+    if (!g_file_set_contents (filename, output.c_str (), output.size (), NULL))
+        g_warning ("can't write %s.\n", filename);
+    g_free (filename);
+    g_free (path);
+}
+
+gboolean
+Diagnostics::signalCallback (gpointer user_data)
+{
+    dump ();
+    return TRUE;
+}
+
+void
+Diagnostics::init (void)
+{
+    g_unix_signal_add (SIGUSR2, Diagnostics::signalCallback, NULL);
+}
+
+};
@@ -0,0 +1,83 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __PY_DIAGNOSTICS_H_
+#define __PY_DIAGNOSTICS_H_
+
+#include <glib.h>
+#include <functional>
+#include <map>
+#include "PYString.h"
+
+namespace PY {
+
+/* live objects, counted from any thread. */
+enum DiagnosticsObject {
+    DIAG_ENGINE = 0,
+    DIAG_EDITOR,
+    DIAG_PINYIN_CONTEXT,
+    DIAG_PINYIN_INSTANCE,
+    DIAG_SQLITE_HANDLE,
+    DIAG_LUA_STATE,
+    DIAG_LAST,
+};
+
+/* approximate memory and object counts per subsystem, written on
+ * SIGUSR2 to stderr and to ~/.cache/ibus/libpinyin/diagnostics.txt. */
+class Diagnostics {
+public:
+    typedef std::function<void (String &)> Reporter;
+
+    static void ref (DiagnosticsObject object)
+    {
+        g_atomic_int_inc (&m_counts[object]);
+    }
+
+    static void unref (DiagnosticsObject object)
+    {
+        g_atomic_int_add (&m_counts[object], -1);
+    }
+
+    /* reporters append their section of the report,
+     * only used from the main thread. */
+    static guint addReporter (const Reporter & reporter);
+    static void removeReporter (guint id);
+
+    static void report (String & output);
+    static void dump (void);
+
+    /* install the SIGUSR2 handler. */
+    static void init (void);
+
+    /* total size of the regular files in a directory. */
+    static gsize directorySize (const gchar *path);
+
+private:
+    static gboolean signalCallback (gpointer user_data);
+
+    static gint m_counts[DIAG_LAST];
+    static std::map<guint, Reporter> m_reporters;
+    static guint m_last_id;
+};
+
+};
+
+#endif
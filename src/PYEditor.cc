@@ -20,6 +20,7 @@
  */
 #include "PYText.h"
 #include "PYEditor.h"
+#include "PYDiagnostics.h"
 
 namespace PY {
 
@@ -29,10 +30,12 @@ Editor::Editor (PinyinProperties & props, Config & config)
       m_props (props),
       m_config (config)
 {
+    Diagnostics::ref (DIAG_EDITOR);
 }
 
 Editor::~Editor (void)
 {
+    Diagnostics::unref (DIAG_EDITOR);
 }
 
 gboolean
@@ -55,6 +55,18 @@ public:
         return m_text;
     }
 
+    /* whether the editor holds any input state, which reset () clears. */
+    virtual gboolean dirty (void) const
+    {
+        return m_cursor != 0 || !m_text.empty ();
+    }
+
+    /* approximate bytes held by the editor, see Diagnostics. */
+    virtual gsize memoryUsage (void) const
+    {
+        return sizeof (*this) + m_text.capacity ();
+    }
+
     void setText (const String & text, guint cursor)
     {
         m_text = text;
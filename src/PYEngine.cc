@@ -21,6 +21,8 @@
 
 #include "PYEngine.h"
 #include <cstring>
+#include "PYDiagnostics.h"
+#include "PYTrace.h"
 #include "PYPPinyinEngine.h"
 #include "PYPBopomofoEngine.h"
 
@@ -194,7 +196,14 @@ ibus_pinyin_engine_process_key_event (IBusEngine     *engine,
                                       guint           modifiers)
 {
     IBusPinyinEngine *pinyin = (IBusPinyinEngine *) engine;
-    return pinyin->engine->processKeyEvent (keyval, keycode, modifiers);
+    gboolean retval;
+    PY_TRACE ("processKeyEvent", "engine");
+
+    pinyin->engine->beginFrame ();
+    retval = pinyin->engine->processKeyEvent (keyval, keycode, modifiers);
+    pinyin->engine->endFrame ();
+
+    return retval;
 }
 
 #if IBUS_CHECK_VERSION (1, 5, 4)
@@ -204,7 +213,9 @@ ibus_pinyin_engine_set_content_type (IBusEngine     *engine,
                                      guint hints)
 {
     IBusPinyinEngine *pinyin = (IBusPinyinEngine *) engine;
-    return pinyin->engine->setContentType (purpose, hints);
+    pinyin->engine->beginFrame ();
+    pinyin->engine->setContentType (purpose, hints);
+    pinyin->engine->endFrame ();
 }
 #endif
 
@@ -214,7 +225,9 @@ ibus_pinyin_engine_property_activate (IBusEngine    *engine,
                                       guint          prop_state)
 {
     IBusPinyinEngine *pinyin = (IBusPinyinEngine *) engine;
+    pinyin->engine->beginFrame ();
     pinyin->engine->propertyActivate (prop_name, prop_state);
+    pinyin->engine->endFrame ();
 }
 static void
 ibus_pinyin_engine_candidate_clicked (IBusEngine *engine,
@@ -223,7 +236,9 @@ ibus_pinyin_engine_candidate_clicked (IBusEngine *engine,
                                       guint       state)
 {
     IBusPinyinEngine *pinyin = (IBusPinyinEngine *) engine;
+    pinyin->engine->beginFrame ();
     pinyin->engine->candidateClicked (index, button, state);
+    pinyin->engine->endFrame ();
 }
 
 #define FUNCTION(name, Name)                                        \
@@ -231,7 +246,9 @@ ibus_pinyin_engine_candidate_clicked (IBusEngine *engine,
     ibus_pinyin_engine_##name (IBusEngine *engine)                  \
     {                                                               \
         IBusPinyinEngine *pinyin = (IBusPinyinEngine *) engine;     \
+        pinyin->engine->beginFrame ();                              \
         pinyin->engine->Name ();                                    \
+        pinyin->engine->endFrame ();                                \
         ((IBusEngineClass *) ibus_pinyin_engine_parent_class)       \
             ->name (engine);                                        \
     }
@@ -246,11 +263,19 @@ FUNCTION(cursor_up,   cursorUp)
 FUNCTION(cursor_down, cursorDown)
 #undef FUNCTION
 
-Engine::Engine (IBusEngine *engine) : m_engine (engine)
+Engine::Engine (IBusEngine *engine)
+    : m_commit_pending (FALSE), m_frame_depth (0), m_engine (engine)
 {
 #if IBUS_CHECK_VERSION (1, 5, 4)
     m_input_purpose = IBUS_INPUT_PURPOSE_FREE_FORM;
 #endif
+    for (guint i = 0; i < UI_LAST; i++) {
+        m_pending[i].content = m_sent[i].content = NULL;
+        m_pending[i].cursor = m_sent[i].cursor = 0;
+        m_pending[i].visible = m_sent[i].visible = FALSE;
+        m_pending[i].valid = m_sent[i].valid = FALSE;
+    }
+    Diagnostics::ref (DIAG_ENGINE);
 }
 
 gboolean
@@ -281,12 +306,335 @@ Engine::setContentType (guint purpose, guint hints)
 
 Engine::~Engine (void)
 {
+    for (guint i = 0; i < UI_LAST; i++) {
+        if (m_pending[i].content)
+            g_object_unref (m_pending[i].content);
+        if (m_sent[i].content)
+            g_object_unref (m_sent[i].content);
+    }
+    Diagnostics::unref (DIAG_ENGINE);
 }
 
-gboolean
-pinyin_accelerator_name(guint keyval, guint modifiers, std::string & name) {
-    name = "";
+void
+Engine::commitText (Text & text)
+{
+    /* the text may be static, copy it. */
+    if (text.text ())
+        m_pending_commit += text.text ();
+    m_commit_pending = TRUE;
+
+    if (m_frame_depth == 0)
+        flushFrame ();
+}
+
+/* Copy a text for the frame, as editors reuse the buffers of their
+ * static texts. */
+static IBusText *
+text_copy (IBusText *text)
+{
+    IBusText *copy = ibus_text_new_from_string (text->text);
+    IBusAttribute *attr;
+    for (guint i = 0; text->attrs &&
+         (attr = ibus_attr_list_get (text->attrs, i)) != NULL; i++)
+        ibus_text_append_attribute (copy, attr->type, attr->value,
+                                    attr->start_index, attr->end_index);
+    return copy;
+}
+
+static gboolean
+text_equal (IBusText *a, IBusText *b)
+{
+    if (g_strcmp0 (a->text, b->text) != 0)
+        return FALSE;
+
+    for (guint i = 0; ; i++) {
+        IBusAttribute *x = a->attrs ? ibus_attr_list_get (a->attrs, i) : NULL;
+        IBusAttribute *y = b->attrs ? ibus_attr_list_get (b->attrs, i) : NULL;
+        if (x == NULL || y == NULL)
+            return x == y;
+        if (x->type != y->type || x->value != y->value ||
+            x->start_index != y->start_index || x->end_index != y->end_index)
+            return FALSE;
+    }
+}
+
+void
+Engine::updatePreeditText (Text & text, guint cursor, gboolean visible)
+{
+    setUIState (UI_PREEDIT, IBUS_SERIALIZABLE (text_copy (text)),
+                cursor, visible);
+}
+
+void
+Engine::showPreeditText (void)
+{
+    setUIVisible (UI_PREEDIT, TRUE);
+}
+
+void
+Engine::hidePreeditText (void)
+{
+    setUIVisible (UI_PREEDIT, FALSE);
+}
 
+void
+Engine::updateAuxiliaryText (Text & text, gboolean visible)
+{
+    setUIState (UI_AUXILIARY, IBUS_SERIALIZABLE (text_copy (text)),
+                0, visible);
+}
+
+void
+Engine::showAuxiliaryText (void)
+{
+    setUIVisible (UI_AUXILIARY, TRUE);
+}
+
+void
+Engine::hideAuxiliaryText (void)
+{
+    setUIVisible (UI_AUXILIARY, FALSE);
+}
+
+/* Copy the candidates which the panel needs to show. Like
+ * ibus_engine_update_lookup_table_fast, small tables are copied
+ * as a whole, and large ones only with the current page. */
+static IBusLookupTable *
+lookup_table_snapshot (IBusLookupTable *table)
+{
+    guint page_size = ibus_lookup_table_get_page_size (table);
+    guint size = ibus_lookup_table_get_number_of_candidates (table);
+    guint cursor = ibus_lookup_table_get_cursor_pos (table);
+    guint begin = 0, end = size;
+
+    if (size >= page_size * 4) {
+        begin = (cursor / page_size) * page_size;
+        end = MIN (begin + page_size, size);
+    }
+
+    IBusLookupTable *snapshot =
+        ibus_lookup_table_new (page_size, 0,
+                               ibus_lookup_table_is_cursor_visible (table),
+                               ibus_lookup_table_is_round (table));
+    ibus_lookup_table_set_orientation
+        (snapshot, ibus_lookup_table_get_orientation (table));
+
+    for (guint i = begin; i < end; i++)
+        ibus_lookup_table_append_candidate
+            (snapshot, ibus_lookup_table_get_candidate (table, i));
+
+    for (guint i = 0; i < page_size; i++) {
+        IBusText *label = ibus_lookup_table_get_label (table, i);
+        if (label == NULL)
+            break;
+        ibus_lookup_table_append_label (snapshot, label);
+    }
+
+    ibus_lookup_table_set_cursor_pos (snapshot, cursor - begin);
+    return snapshot;
+}
+
+/* the candidates of a snapshot are shared, so most are equal by pointer. */
+static gboolean
+lookup_table_equal (IBusLookupTable *a, IBusLookupTable *b)
+{
+    guint size = ibus_lookup_table_get_number_of_candidates (a);
+    guint page_size = ibus_lookup_table_get_page_size (a);
+
+    if (size != ibus_lookup_table_get_number_of_candidates (b) ||
+        page_size != ibus_lookup_table_get_page_size (b) ||
+        ibus_lookup_table_get_cursor_pos (a) != ibus_lookup_table_get_cursor_pos (b) ||
+        ibus_lookup_table_is_cursor_visible (a) != ibus_lookup_table_is_cursor_visible (b) ||
+        ibus_lookup_table_is_round (a) != ibus_lookup_table_is_round (b) ||
+        ibus_lookup_table_get_orientation (a) != ibus_lookup_table_get_orientation (b))
+        return FALSE;
+
+    for (guint i = 0; i < size; i++) {
+        IBusText *x = ibus_lookup_table_get_candidate (a, i);
+        IBusText *y = ibus_lookup_table_get_candidate (b, i);
+        if (x != y && !text_equal (x, y))
+            return FALSE;
+    }
+
+    for (guint i = 0; i < page_size; i++) {
+        IBusText *x = ibus_lookup_table_get_label (a, i);
+        IBusText *y = ibus_lookup_table_get_label (b, i);
+        if (x == NULL || y == NULL) {
+            if (x != y)
+                return FALSE;
+            break;
+        }
+        if (x != y && !text_equal (x, y))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+void
+Engine::updateLookupTable (LookupTable &table, gboolean visible)
+{
+    setUIState (UI_LOOKUP_TABLE, IBUS_SERIALIZABLE (lookup_table_snapshot (table)),
+                0, visible);
+}
+
+void
+Engine::updateLookupTableFast (LookupTable &table, gboolean visible)
+{
+    /* the snapshot only carries the current page of large tables. */
+    updateLookupTable (table, visible);
+}
+
+void
+Engine::showLookupTable (void)
+{
+    setUIVisible (UI_LOOKUP_TABLE, TRUE);
+}
+
+void
+Engine::hideLookupTable (void)
+{
+    setUIVisible (UI_LOOKUP_TABLE, FALSE);
+}
+
+void
+Engine::setUIState (guint element, IBusSerializable *content,
+                    guint cursor, gboolean visible)
+{
+    UIState & pending = m_pending[element];
+
+    /* content is a copy, the editor may change the text or table
+     * again before the frame is flushed. */
+    g_object_ref_sink (content);
+    if (pending.content)
+        g_object_unref (pending.content);
+    pending.content = content;
+    pending.cursor = cursor;
+    pending.visible = visible;
+    pending.valid = TRUE;
+
+    if (m_frame_depth == 0)
+        flushFrame ();
+}
+
+void
+Engine::setUIVisible (guint element, gboolean visible)
+{
+    UIState & pending = m_pending[element];
+
+    pending.visible = visible;
+    pending.valid = TRUE;
+
+    if (m_frame_depth == 0)
+        flushFrame ();
+}
+
+void
+Engine::flushFrame (void)
+{
+    /* the commits come before the preedit which follows them. */
+    if (m_commit_pending) {
+        Text text (m_pending_commit);
+        ibus_engine_commit_text (m_engine, text);
+        m_pending_commit.clear ();
+        m_commit_pending = FALSE;
+    }
+
+    for (guint i = 0; i < UI_LAST; i++)
+        flushUIState (i);
+}
+
+void
+Engine::flushUIState (guint element)
+{
+    UIState & pending = m_pending[element];
+    UIState & sent = m_sent[element];
+
+    if (!pending.valid)
+        return;
+    pending.valid = FALSE;
+
+    if (!pending.visible) {
+        if (sent.valid && !sent.visible)
+            return;
+        switch (element) {
+        case UI_PREEDIT:
+            ibus_engine_hide_preedit_text (m_engine);
+            break;
+        case UI_AUXILIARY:
+            ibus_engine_hide_auxiliary_text (m_engine);
+            break;
+        case UI_LOOKUP_TABLE:
+            ibus_engine_hide_lookup_table (m_engine);
+            break;
+        }
+        sent.visible = FALSE;
+        sent.valid = TRUE;
+        return;
+    }
+
+    gboolean same = sent.valid &&
+                    sent.content != NULL &&
+                    pending.content != NULL &&
+                    sent.cursor == pending.cursor &&
+                    (element == UI_LOOKUP_TABLE ?
+                     lookup_table_equal (IBUS_LOOKUP_TABLE (sent.content),
+                                         IBUS_LOOKUP_TABLE (pending.content)) :
+                     text_equal (IBUS_TEXT (sent.content),
+                                 IBUS_TEXT (pending.content)));
+
+    if (same || pending.content == NULL) {
+        if (sent.valid && sent.visible)
+            return;
+        switch (element) {
+        case UI_PREEDIT:
+            ibus_engine_show_preedit_text (m_engine);
+            break;
+        case UI_AUXILIARY:
+            ibus_engine_show_auxiliary_text (m_engine);
+            break;
+        case UI_LOOKUP_TABLE:
+            ibus_engine_show_lookup_table (m_engine);
+            break;
+        }
+        sent.visible = TRUE;
+        sent.valid = TRUE;
+        return;
+    }
+
+    /* the copies are sent as they are, ibus serializes them once. */
+    switch (element) {
+    case UI_PREEDIT:
+        ibus_engine_update_preedit_text (m_engine, IBUS_TEXT (pending.content),
+                                         pending.cursor, TRUE);
+        break;
+    case UI_AUXILIARY:
+        ibus_engine_update_auxiliary_text (m_engine, IBUS_TEXT (pending.content),
+                                           TRUE);
+        break;
+    case UI_LOOKUP_TABLE:
+        ibus_engine_update_lookup_table (m_engine, IBUS_LOOKUP_TABLE (pending.content),
+                                         TRUE);
+        break;
+    }
+
+    if (sent.content)
+        g_object_unref (sent.content);
+    sent.content = (IBusSerializable *) g_object_ref (pending.content);
+    sent.cursor = pending.cursor;
+    sent.visible = TRUE;
+    sent.valid = TRUE;
+}
+
+void
+Engine::invalidateFrame (void)
+{
+    for (guint i = 0; i < UI_LAST; i++)
+        m_sent[i].valid = FALSE;
+}
+
+void
+pinyin_accelerator_normalize (guint & keyval, guint & modifiers)
+{
     /* Convert some key press to modifiers. */
     switch (keyval) {
     case IBUS_KEY_Control_L:
@@ -319,8 +667,26 @@ pinyin_accelerator_name(guint keyval, guint modifiers, std::string & name) {
         modifiers |= IBUS_HYPER_MASK;
         keyval = 0;
         break;
+    default:
+        keyval = ibus_keyval_to_lower (keyval);
+        break;
     }
 
+    /* Only keep the modifiers which appear in accelerator names. */
+    modifiers &= (IBUS_CONTROL_MASK |
+                  IBUS_MOD1_MASK |
+                  IBUS_SHIFT_MASK |
+                  IBUS_META_MASK |
+                  IBUS_SUPER_MASK |
+                  IBUS_HYPER_MASK);
+}
+
+gboolean
+pinyin_accelerator_name(guint keyval, guint modifiers, std::string & name) {
+    name = "";
+
+    pinyin_accelerator_normalize (keyval, modifiers);
+
     /* Convert modifiers. */
     if (modifiers & IBUS_CONTROL_MASK)
         name += "<Control>";
@@ -338,12 +704,12 @@ pinyin_accelerator_name(guint keyval, guint modifiers, std::string & name) {
 
     /* Convert keyval. */
     if (keyval) {
-        const gchar * symbol = ibus_keyval_name (ibus_keyval_to_lower (keyval));
-        name += symbol;
+        const gchar * symbol = ibus_keyval_name (keyval);
+        if (symbol)
+            name += symbol;
     }
 
     return TRUE;
 }
 
 };
-
@@ -22,6 +22,7 @@
 #define __PY_ENGINE_H_
 
 #include <ibus.h>
+#include <string>
 
 #include "PYPointer.h"
 #include "PYLookupTable.h"
@@ -59,61 +60,43 @@ public:
     virtual gboolean propertyActivate (const gchar *prop_name, guint prop_state) = 0;
     virtual void candidateClicked (guint index, guint button, guint state) = 0;
 
-protected:
-    void commitText (Text & text) const
-    {
-        ibus_engine_commit_text (m_engine, text);
-    }
-
-    void updatePreeditText (Text & text, guint cursor, gboolean visible) const
-    {
-        ibus_engine_update_preedit_text (m_engine, text, cursor, visible);
-    }
-
-    void showPreeditText (void) const
-    {
-        ibus_engine_show_preedit_text (m_engine);
-    }
-
-    void hidePreeditText (void) const
-    {
-        ibus_engine_hide_preedit_text (m_engine);
-    }
-
-    void updateAuxiliaryText (Text & text, gboolean visible) const
-    {
-        ibus_engine_update_auxiliary_text (m_engine, text, visible);
-    }
-
-    void showAuxiliaryText (void) const
-    {
-        ibus_engine_show_auxiliary_text (m_engine);
-    }
-
-    void hideAuxiliaryText (void) const
+    /* UI changes made between beginFrame and endFrame are sent
+     * together when the outermost frame ends, and only the parts
+     * which differ from what was last sent go out to ibus.  The
+     * commits of the frame go out first, as one commit, then the
+     * preedit, auxiliary text and lookup table, so a client never
+     * sees the preedit of a frame before the text it committed. */
+    void beginFrame (void)
     {
-        ibus_engine_hide_auxiliary_text (m_engine);
+        m_frame_depth++;
     }
 
-    void updateLookupTable (LookupTable &table, gboolean visible) const
+    void endFrame (void)
     {
-        ibus_engine_update_lookup_table (m_engine, table, visible);
+        g_assert (m_frame_depth > 0);
+        if (--m_frame_depth == 0)
+            flushFrame ();
     }
 
-    void updateLookupTableFast (LookupTable &table, gboolean visible) const
-    {
-        ibus_engine_update_lookup_table_fast (m_engine, table, visible);
-    }
-
-    void showLookupTable (void) const
-    {
-        ibus_engine_show_lookup_table (m_engine);
-    }
-
-    void hideLookupTable (void) const
-    {
-        ibus_engine_hide_lookup_table (m_engine);
-    }
+protected:
+    /* collected into the frame too, see beginFrame and endFrame. */
+    void commitText (Text & text);
+
+    /* preedit, auxiliary text and lookup table changes are
+     * collected into a frame, see beginFrame and endFrame. */
+    void updatePreeditText (Text & text, guint cursor, gboolean visible);
+    void showPreeditText (void);
+    void hidePreeditText (void);
+    void updateAuxiliaryText (Text & text, gboolean visible);
+    void showAuxiliaryText (void);
+    void hideAuxiliaryText (void);
+    void updateLookupTable (LookupTable &table, gboolean visible);
+    void updateLookupTableFast (LookupTable &table, gboolean visible);
+    void showLookupTable (void);
+    void hideLookupTable (void);
+
+    /* forget what was sent, e.g. after ibus hid the UI on its own. */
+    void invalidateFrame (void);
 
     void registerProperties (PropList & props) const
     {
@@ -125,6 +108,35 @@ protected:
         ibus_engine_update_property (m_engine, prop);
     }
 
+private:
+    enum {
+        UI_PREEDIT = 0,
+        UI_AUXILIARY,
+        UI_LOOKUP_TABLE,
+        UI_LAST,
+    };
+
+    struct UIState {
+        IBusSerializable *content;  // a private copy of the IBusText
+                                    // or IBusLookupTable
+        guint cursor;
+        gboolean visible;
+        gboolean valid;         // pending: changed in this frame,
+                                // sent: known to match ibus
+    };
+
+    void setUIState (guint element, IBusSerializable *content,
+                     guint cursor, gboolean visible);
+    void setUIVisible (guint element, gboolean visible);
+    void flushFrame (void);
+    void flushUIState (guint element);
+
+    std::string m_pending_commit;
+    gboolean m_commit_pending;
+    UIState m_pending[UI_LAST];
+    UIState m_sent[UI_LAST];
+    guint m_frame_depth;
+
 protected:
     Pointer<IBusEngine>  m_engine;      // engine pointer
 
@@ -134,6 +146,8 @@ protected:
 
 };
 
+void pinyin_accelerator_normalize (guint & keyval, guint & modifiers);
+
 gboolean pinyin_accelerator_name(guint keyval, guint modifiers,
                                  std::string & name);
 
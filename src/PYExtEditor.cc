@@ -31,6 +31,9 @@ extern "C" {
 
 #include "PYEditor.h"
 #include "PYExtEditor.h"
+#include "PYSpecialPhraseTable.h"
+#include "PYDiagnostics.h"
+#include "PYTrace.h"
 
 namespace PY {
 
@@ -67,7 +70,7 @@ static unit_t units_traditional[] ={
 };
 
 
-static const std::string
+const std::string
 simplest_cn_number(gint64 num)
 {
     std::string result = "";
@@ -130,13 +133,13 @@ translate_to_longform(gint64 num, const char * number[10], unit_t units[], int u
     return result;
 }
 
-static const std::string
+const std::string
 simplified_number(gint64 num)
 {
     return translate_to_longform(num, numbers[1], units_simplified, G_N_ELEMENTS(units_simplified));
 }
 
-static const std::string
+const std::string
 traditional_number(gint64 num)
 {
     if ( 0 == num )
@@ -147,7 +150,7 @@ traditional_number(gint64 num)
 
 
 /* Write digit/alpha/none Label generator here.
- * foreach (results): 1, from get_retval; 2..n from get_retvals.
+ * foreach (results): from ibus_engine_plugin_call_command_finish.
  */
 
 ExtEditor::ExtEditor (PinyinProperties & props, Config & config)
@@ -155,17 +158,98 @@ ExtEditor::ExtEditor (PinyinProperties & props, Config & config)
       m_mode (LABEL_NONE),
       m_result_num (0),
       m_candidate (NULL),
-      m_candidates (NULL)
+      m_candidates (NULL),
+      m_cancellable (NULL),
+      m_fetch_cancellable (NULL)
 {
-    m_lua_plugin = ibus_engine_plugin_new ();
+    IBusEnginePlugin *plugin = newLuaPlugin ();
+    m_lua_plugin = plugin;
+    g_object_unref (plugin);
+}
+
+ExtEditor::~ExtEditor (void)
+{
+    cancelCommand ();
+    clearCommandResults ();
+    m_lua_plugin = NULL;
+}
+
+gboolean ExtEditor::m_shared_enabled = FALSE;
+IBusEnginePlugin *ExtEditor::m_shared_plugin = NULL;
+IBusEnginePlugin *ExtEditor::m_trigger_plugin = NULL;
+guint ExtEditor::m_trigger_idle_id = 0;
+
+void
+ExtEditor::setSharedPlugin (gboolean shared)
+{
+    m_shared_enabled = shared;
+}
+
+void
+ExtEditor::luaPluginFinalized (gpointer data, GObject *plugin)
+{
+    Diagnostics::unref (DIAG_LUA_STATE);
+}
+
+/* Returns a new reference to a plugin with base.lua and user.lua loaded,
+ * shared by all editors when enabled, the shared plugin goes away
+ * with the last editor using it.
+ */
+IBusEnginePlugin *
+ExtEditor::newLuaPlugin (void)
+{
+    if (m_shared_enabled && m_shared_plugin != NULL)
+        return (IBusEnginePlugin *) g_object_ref (m_shared_plugin);
+
+    IBusEnginePlugin *plugin = ibus_engine_plugin_new ();
+    Diagnostics::ref (DIAG_LUA_STATE);
+    g_object_weak_ref (G_OBJECT (plugin), luaPluginFinalized, NULL);
 
-    loadLuaScript ( ".." G_DIR_SEPARATOR_S "lua" G_DIR_SEPARATOR_S "base.lua")||
-        loadLuaScript (PKGDATADIR G_DIR_SEPARATOR_S "base.lua");
+    ibus_engine_plugin_load_lua_script
+        (plugin, ".." G_DIR_SEPARATOR_S "lua" G_DIR_SEPARATOR_S "base.lua") == 0 ||
+        ibus_engine_plugin_load_lua_script
+        (plugin, PKGDATADIR G_DIR_SEPARATOR_S "base.lua");
 
     gchar * path = g_build_filename (g_get_user_config_dir (),
                              "ibus", "libpinyin", "user.lua", NULL);
-    loadLuaScript(path);
+    ibus_engine_plugin_load_lua_script (plugin, path);
     g_free(path);
+
+    if (m_shared_enabled) {
+        m_shared_plugin = plugin;
+        g_object_add_weak_pointer (G_OBJECT (plugin),
+                                   (gpointer *) &m_shared_plugin);
+    }
+    return plugin;
+}
+
+/* Typing never waits on the lua scripts, the first call schedules the
+ * load and the triggers are skipped until it is done. With a shared
+ * plugin, it is the plugin of the editors too.
+ */
+IBusEnginePlugin *
+ExtEditor::triggerPlugin (void)
+{
+    if (m_trigger_plugin == NULL && m_trigger_idle_id == 0)
+        m_trigger_idle_id = g_idle_add_full (G_PRIORITY_LOW,
+                                             triggerPluginIdle, NULL, NULL);
+    return m_trigger_plugin;
+}
+
+gboolean
+ExtEditor::triggerPluginIdle (gpointer data)
+{
+    m_trigger_idle_id = 0;
+    /* kept for the process. */
+    m_trigger_plugin = newLuaPlugin ();
+    return FALSE;
+}
+
+gsize
+ExtEditor::memoryUsage (void) const
+{
+    return Editor::memoryUsage () +
+        ibus_engine_plugin_get_memory_usage (m_lua_plugin);
 }
 
 int
@@ -177,8 +261,19 @@ ExtEditor::loadLuaScript (std::string filename)
 void
 ExtEditor::resetLuaState ()
 {
-  g_object_unref (m_lua_plugin);
-  m_lua_plugin = ibus_engine_plugin_new ();
+  cancelCommand ();
+  clearCommandResults ();
+  /* other editors keep the old shared plugin until they reset. */
+  if (m_shared_plugin == m_lua_plugin && m_shared_plugin != NULL) {
+      g_object_remove_weak_pointer (G_OBJECT (m_shared_plugin),
+                                    (gpointer *) &m_shared_plugin);
+      m_shared_plugin = NULL;
+  }
+  IBusEnginePlugin *plugin = ibus_engine_plugin_new ();
+  Diagnostics::ref (DIAG_LUA_STATE);
+  g_object_weak_ref (G_OBJECT (plugin), luaPluginFinalized, NULL);
+  m_lua_plugin = plugin;
+  g_object_unref (plugin);
 }
 
 
@@ -335,6 +430,7 @@ ExtEditor::processLabelKey (guint keyval)
 
     switch (m_mode) {
     case LABEL_LIST_DIGIT:
+    case LABEL_LIST_PHRASES:
         switch (keyval) {
         case '1' ... '9':
             return selectCandidateInPage (keyval - '1');
@@ -376,6 +472,7 @@ ExtEditor::processSpace (guint keyval)
     case LABEL_LIST_COMMANDS:
     case LABEL_LIST_DIGIT:
     case LABEL_LIST_ALPHA:
+    case LABEL_LIST_PHRASES:
         selectCandidate (cursor_pos);
         break;
     case LABEL_LIST_SINGLE:
@@ -414,6 +511,7 @@ ExtEditor::pageUp (void)
 void
 ExtEditor::pageDown (void)
 {
+    fetchCandidates ();
     if (G_LIKELY(m_lookup_table.pageDown ())) {
         update ();
     }
@@ -465,6 +563,7 @@ ExtEditor::cursorUp (void)
 void
 ExtEditor::cursorDown (void)
 {
+    fetchCandidates ();
     if (G_LIKELY (m_lookup_table.cursorDown ())) {
         update ();
     }
@@ -473,6 +572,7 @@ ExtEditor::cursorDown (void)
 void
 ExtEditor::update (void)
 {
+    PY_TRACE ("ExtEditor::update", "editor");
     updateLookupTable ();
     updatePreeditText ();
     updateAuxiliaryText ();
@@ -508,6 +608,10 @@ ExtEditor::selectCandidateInPage (guint index)
 gboolean
 ExtEditor::selectCandidate (guint index)
 {
+    /* the candidates of the pending call are not there yet. */
+    if (m_cancellable != NULL)
+        return FALSE;
+
     switch (m_mode) {
     case LABEL_LIST_NUMBERS:
         {
@@ -524,22 +628,14 @@ ExtEditor::selectCandidate (guint index)
     case LABEL_LIST_COMMANDS:
         {
             std::string prefix = m_text.substr (1, 2);
-            int len = prefix.length ();
-            const char * prefix_str = prefix.c_str ();
-            const GArray * commands = ibus_engine_plugin_get_available_commands (m_lua_plugin);
-            int match_count = -1;
-            for (int i = 0; i < static_cast<int>(commands->len); ++i) {
-                lua_command_t * command = &g_array_index (commands, lua_command_t, i);
-                if ( strncmp (prefix_str, command->command_name, len) == 0 ) {
-                    match_count++;
-                }
-                if ( match_count == static_cast<int>(index) ) {
-                    m_text.clear ();
-                    m_text = "i";
-                    m_text += command->command_name;
-                    m_cursor = m_text.length ();
-                    break;
-                }
+            guint count = 0;
+            const lua_command_t * commands =
+                ibus_engine_plugin_get_commands_with_prefix (m_lua_plugin, prefix.c_str (), &count);
+            if ( index < count ) {
+                m_text.clear ();
+                m_text = "i";
+                m_text += commands[index].command_name;
+                m_cursor = m_text.length ();
             }
             updateStateFromInput ();
             update ();
@@ -549,10 +645,10 @@ ExtEditor::selectCandidate (guint index)
     case LABEL_LIST_DIGIT:
     case LABEL_LIST_ALPHA:
         {
-            g_return_val_if_fail (m_result_num > 1, FALSE);
+            g_return_val_if_fail (m_result_num > 0, FALSE);
             g_return_val_if_fail (static_cast<int>(index) < m_result_num, FALSE);
 
-            const lua_command_candidate_t * candidate = g_array_index (m_candidates, lua_command_candidate_t *, index);
+            const lua_command_candidate_t * candidate = &m_candidates->candidates[index];
             if ( candidate->content ) {
                 Text text (candidate->content);
                 commitText (text);
@@ -567,6 +663,19 @@ ExtEditor::selectCandidate (guint index)
         }
         return TRUE;
         break;
+    case LABEL_LIST_PHRASES:
+        {
+            if ( index >= m_special_phrases.size () )
+                return FALSE;
+
+            Text text (m_special_phrases[index]);
+            commitText (text);
+            m_text.clear ();
+            updateStateFromInput ();
+            update ();
+            return TRUE;
+        }
+        break;
     case LABEL_LIST_SINGLE:
         {
             g_return_val_if_fail (m_result_num == 1, FALSE);
@@ -594,6 +703,9 @@ bool
 ExtEditor::updateStateFromInput (void)
 {
     /* Do parse and candidates update here. */
+    /* the results of the pending call are stale now. */
+    cancelCommand ();
+
     /* prefix i double check here. */
     if ( !m_text.length () ) {
         m_preedit_text = "";
@@ -649,6 +761,21 @@ ExtEditor::updateStateFromInput (void)
 
             const lua_command_t * command = ibus_engine_plugin_lookup_command (m_lua_plugin, command_name.c_str ());
             if ( NULL == command) {
+                /* the input may fire a trigger instead of a command. */
+                const lua_command_t * trigger = NULL;
+                if ( ibus_engine_plugin_match_triggers (m_lua_plugin, LUA_TRIGGER_INPUT,
+                                                        m_text.c_str () + 1, &trigger, 1) ) {
+                    m_auxiliary_text = m_text[0];
+                    m_auxiliary_text += " ";
+                    m_auxiliary_text += trigger->description;
+                    m_mode = LABEL_LIST_DIGIT;
+                    fillCommand (trigger, m_text.c_str () + 1);
+                    return true;
+                }
+
+                if ( fillSpecialPhrases () )
+                    return true;
+
                 m_mode = LABEL_NONE;
                 clearLookupTable ();
                 m_lookup_table.clear ();
@@ -704,20 +831,16 @@ ExtEditor::fillCommandCandidates (std::string prefix)
     clearLookupTable ();
 
     /* fill candidates here. */
-    int len = prefix.length ();
-    const char * prefix_str = prefix.c_str ();
-    const GArray * commands = ibus_engine_plugin_get_available_commands (m_lua_plugin);
-    int count = -1;
-    for ( int i = 0; i < static_cast<int>(commands->len); ++i) {
-        lua_command_t * command = &g_array_index (commands, lua_command_t, i);
-        if ( strncmp (prefix_str, command->command_name, len) == 0) {
-            count++;
-            std::string candidate = command->command_name;
-            candidate += ".";
-            candidate += command->description;
-            m_lookup_table.setLabel (count, Text (""));
-            m_lookup_table.appendCandidate (Text (candidate));
-        }
+    guint count = 0;
+    const lua_command_t * commands =
+        ibus_engine_plugin_get_commands_with_prefix (m_lua_plugin, prefix.c_str (), &count);
+    for ( guint i = 0; i < count; ++i) {
+        const lua_command_t * command = &commands[i];
+        std::string candidate = command->command_name;
+        candidate += ".";
+        candidate += command->description;
+        m_lookup_table.setLabel (i, Text (""));
+        m_lookup_table.appendCandidate (Text (candidate));
     }
 
     return true;
@@ -730,26 +853,92 @@ ExtEditor::fillCommand (std::string command_name, const char * argument)
     if ( NULL == command )
         return false;
 
-    if ( m_result_num != 0) {
-        if ( m_result_num == 1) {
-            ibus_engine_plugin_free_candidate ((lua_command_candidate_t *)m_candidate);
-            m_candidate = NULL;
-        }else{
-            for ( int i = 0; i < m_result_num; ++i) {
-                const lua_command_candidate_t * candidate = g_array_index (m_candidates, lua_command_candidate_t *, i);
-                ibus_engine_plugin_free_candidate ((lua_command_candidate_t *)candidate);
-            }
+    return fillCommand (command, argument);
+}
 
-            g_array_free (m_candidates, TRUE);
-            m_candidates = NULL;
-        }
-        m_result_num = 0;
-        g_assert (m_candidates == NULL && m_candidate == NULL);
+bool
+ExtEditor::fillCommand (const lua_command_t * command, const char * argument)
+{
+    cancelCommand ();
+    clearCommandResults ();
+    clearLookupTable ();
+
+    /* the lookup table is filled in commandReady. */
+    m_cancellable = g_cancellable_new ();
+    ibus_engine_plugin_call_command_async (m_lua_plugin, command, argument,
+                                           m_cancellable,
+                                           commandReadyCallback, this);
+    return true;
+}
+
+void
+ExtEditor::cancelCommand (void)
+{
+    if (m_fetch_cancellable != NULL) {
+        g_cancellable_cancel (m_fetch_cancellable);
+        g_object_unref (m_fetch_cancellable);
+        m_fetch_cancellable = NULL;
+    }
+
+    if (m_cancellable == NULL)
+        return;
+
+    g_cancellable_cancel (m_cancellable);
+    g_object_unref (m_cancellable);
+    m_cancellable = NULL;
+}
+
+void
+ExtEditor::clearCommandResults (void)
+{
+    /* the candidates may be shared with the result cache of the plugin. */
+    if ( m_candidates )
+        ibus_engine_plugin_candidates_unref (m_candidates);
+    m_candidates = NULL;
+    m_candidate = NULL;
+    m_result_num = 0;
+}
+
+void
+ExtEditor::commandReadyCallback (GObject * source,
+                                 GAsyncResult * result,
+                                 gpointer user_data)
+{
+    /* a cancelled call may outlive its editor, drop its results. */
+    if (g_cancellable_is_cancelled (g_task_get_cancellable (G_TASK (result))))
+        return;
+
+    ExtEditor *self = static_cast<ExtEditor *> (user_data);
+    lua_command_candidates_t * candidates = NULL;
+    int result_num = ibus_engine_plugin_call_command_finish
+        (IBUS_ENGINE_PLUGIN (source), result, &candidates);
+    self->commandReady (result_num, candidates);
+}
+
+void
+ExtEditor::commandReady (int result_num, lua_command_candidates_t * candidates)
+{
+    PY_TRACE ("ExtEditor::commandReady", "lua");
+
+    g_object_unref (m_cancellable);
+    m_cancellable = NULL;
+
+    if ( LUA_PLUGIN_CALL_TIMED_OUT == result_num ) {
+        /* show the timeout, the candidate can't be selected. */
+        m_mode = LABEL_LIST_NONE;
+        clearLookupTable ();
+        m_lookup_table.setLabel (0, Text (""));
+        m_lookup_table.appendCandidate (Text ("(超时)"));
+        update ();
+        return;
     }
 
-    m_result_num = ibus_engine_plugin_call (m_lua_plugin, command->lua_function_name, argument);
+    m_result_num = std::max (result_num, 0);
+    m_candidates = candidates;
+    if ( 1 == m_result_num && !candidates->more )
+        m_candidate = &candidates->candidates[0];
 
-    if ( 1 == m_result_num )
+    if ( 1 == m_result_num && !candidates->more )
         m_mode = LABEL_LIST_SINGLE;
 
     clearLookupTable ();
@@ -772,8 +961,7 @@ ExtEditor::fillCommand (std::string command_name, const char * argument)
 
     //Generate candidates
     std::string result;
-    if ( 1 == m_result_num ) {
-        m_candidate = ibus_engine_plugin_get_retval (m_lua_plugin);
+    if ( m_candidate ) {
         result = "";
         if ( m_candidate->content ) {
             result = m_candidate->content;
@@ -789,28 +977,109 @@ ExtEditor::fillCommand (std::string command_name, const char * argument)
         }
 
         m_lookup_table.appendCandidate (Text (result));
-    }else if (m_result_num > 1) {
-        m_candidates = ibus_engine_plugin_get_retvals (m_lua_plugin);
-        for ( int i = 0; i < m_result_num; ++i) {
-            const lua_command_candidate_t * candidate = g_array_index (m_candidates, lua_command_candidate_t *, i);
-            result = "";
-            if ( candidate->content ) {
-                result = candidate->content;
-                if (strstr (result.c_str (), "\n"))
-                    result = "(字符画)";
-            }
-            if ( candidate->suggest && candidate-> help ) {
-                result += candidate->suggest;
-                result += " ";
-                result += "[";
-                result += candidate->help;
-                result += "]";
-            }
+    }else if (m_result_num > 0) {
+        appendCandidates (0);
+    }
 
-            m_lookup_table.appendCandidate (Text (result));
+    update ();
+}
+
+void
+ExtEditor::appendCandidates (guint from)
+{
+    std::string result;
+    for ( guint i = from; i < m_candidates->len; ++i) {
+        const lua_command_candidate_t * candidate = &m_candidates->candidates[i];
+        result = "";
+        if ( candidate->content ) {
+            result = candidate->content;
+            if (strstr (result.c_str (), "\n"))
+                result = "(字符画)";
+        }
+        if ( candidate->suggest && candidate-> help ) {
+            result += candidate->suggest;
+            result += " ";
+            result += "[";
+            result += candidate->help;
+            result += "]";
         }
+
+        m_lookup_table.appendCandidate (Text (result));
     }
+}
+
+void
+ExtEditor::fetchCandidates (void)
+{
+    /* keep the next page and one more page of lazy results. */
+    if ( m_cancellable || m_fetch_cancellable ||
+         NULL == m_candidates || !m_candidates->more )
+        return;
+
+    guint len = m_lookup_table.cursorPos () + 2 * m_lookup_table.pageSize ();
+    if ( len <= m_candidates->len )
+        return;
+
+    /* the candidates are appended in fetchReady. */
+    m_fetch_cancellable = g_cancellable_new ();
+    ibus_engine_plugin_fetch_candidates_async (m_lua_plugin, m_candidates, len,
+                                               m_fetch_cancellable,
+                                               fetchReadyCallback, this);
+}
+
+void
+ExtEditor::fetchReadyCallback (GObject * source,
+                               GAsyncResult * result,
+                               gpointer user_data)
+{
+    /* a cancelled fetch may outlive its editor, drop its results. */
+    if (g_cancellable_is_cancelled (g_task_get_cancellable (G_TASK (result))))
+        return;
+
+    ExtEditor *self = static_cast<ExtEditor *> (user_data);
+    self->fetchReady (ibus_engine_plugin_fetch_candidates_finish
+                      (IBUS_ENGINE_PLUGIN (source), result));
+}
+
+void
+ExtEditor::fetchReady (lua_command_candidates_t * candidates)
+{
+    g_object_unref (m_fetch_cancellable);
+    m_fetch_cancellable = NULL;
+
+    if ( NULL == candidates )
+        return;
+
+    guint from = m_candidates->len;
+    ibus_engine_plugin_candidates_unref (m_candidates);
+    m_candidates = candidates;
+    m_result_num = candidates->len;
+    appendCandidates (from);
+    updateLookupTable ();
+}
 
+bool
+ExtEditor::fillSpecialPhrases (void)
+{
+    m_special_phrases.clear ();
+
+    SpecialPhraseTable *table = SpecialPhraseTable::instance ();
+    if ( NULL == table || !m_config.specialPhrases () )
+        return false;
+
+    /* the keys of special_table start with a lower case "i". */
+    std::string key = "i";
+    key += m_text.substr (1);
+    table->lookup (key.c_str (), m_special_phrases);
+    if ( m_special_phrases.empty () )
+        return false;
+
+    m_mode = LABEL_LIST_PHRASES;
+    clearLookupTable ();
+    for ( int i = 1; i <= 10; ++i )
+        m_lookup_table.setLabel ( i - 1, Text (i - 1 + '1') );
+    for ( guint i = 0; i < m_special_phrases.size (); ++i )
+        m_lookup_table.appendCandidate (Text (m_special_phrases[i]));
     return true;
 }
 
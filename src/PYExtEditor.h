@@ -22,16 +22,26 @@
 #define __PY_EXT_EDITOR_
 
 #include <glib.h>
+#include <string>
+#include <vector>
 
 typedef struct _IBusEnginePlugin IBusEnginePlugin;
+typedef struct _lua_command_t lua_command_t;
 typedef struct _lua_command_candidate_t lua_command_candidate_t;
+typedef struct _lua_command_candidates_t lua_command_candidates_t;
 
 namespace PY {
 
 
+/* Chinese number formatters of the extension mode. */
+const std::string simplest_cn_number (gint64 num);
+const std::string simplified_number (gint64 num);
+const std::string traditional_number (gint64 num);
+
 class ExtEditor : public Editor {
 public:
     ExtEditor (PinyinProperties & props, Config & config);
+    virtual ~ExtEditor (void);
 
     virtual gboolean processKeyEvent (guint keyval, guint keycode, guint modifiers);
     virtual void pageUp (void);
@@ -41,19 +51,48 @@ public:
     virtual void update (void);
     virtual void reset (void);
     virtual void candidateClicked (guint index, guint button, guint state);
+    virtual gsize memoryUsage (void) const;
 
     int loadLuaScript (std::string filename);
     void resetLuaState (void);
 
+    /* share one lua state and command registry between all editors. */
+    static void setSharedPlugin (gboolean shared);
+    /* the plugin the phonetic editors run the triggers with, one for
+     * the process, or NULL until it is loaded from an idle callback. */
+    static IBusEnginePlugin * triggerPlugin (void);
+
 private:
+    static IBusEnginePlugin * newLuaPlugin (void);
+    static void luaPluginFinalized (gpointer data, GObject *plugin);
+    static gboolean triggerPluginIdle (gpointer data);
+
     bool updateStateFromInput (void);
 
     /* Fill lookup table, and update preedit string. */
     bool fillCommandCandidates (void);
     bool fillCommandCandidates (std::string prefix);
     bool fillCommand (std::string command_name, const char * argument);
+    bool fillCommand (const lua_command_t * command, const char * argument);
+
+    /* lua commands run on the worker thread of the plugin. */
+    void cancelCommand (void);
+    void clearCommandResults (void);
+    void commandReady (int result_num, lua_command_candidates_t * candidates);
+    void appendCandidates (guint from);
+    /* pull more lazy results as the cursor moves down. */
+    void fetchCandidates (void);
+    void fetchReady (lua_command_candidates_t * candidates);
+    static void fetchReadyCallback (GObject * source,
+                                    GAsyncResult * result,
+                                    gpointer user_data);
+    static void commandReadyCallback (GObject * source,
+                                      GAsyncResult * result,
+                                      gpointer user_data);
 
     bool fillChineseNumber(gint64 num);
+    /* the special phrases of the input, special_table is typed here. */
+    bool fillSpecialPhrases (void);
 
     /* Auxiliary functions for lookup table */
     void clearLookupTable (void);
@@ -82,6 +121,7 @@ private:
         LABEL_LIST_DIGIT,
         LABEL_LIST_ALPHA,
         LABEL_LIST_SINGLE,
+        LABEL_LIST_PHRASES,
         LABEL_LAST,
     };
     LabelMode m_mode;
@@ -95,9 +135,19 @@ private:
     //saved lua extension call results.
     int m_result_num;
     const lua_command_candidate_t * m_candidate;
-    GArray * m_candidates;
+    lua_command_candidates_t * m_candidates;
+    /* the pending lua command call, or NULL. */
+    GCancellable * m_cancellable;
+    GCancellable * m_fetch_cancellable;
+
+    std::vector<std::string> m_special_phrases;
 
     const static int m_aux_text_len = 50;
+
+    static gboolean m_shared_enabled;
+    static IBusEnginePlugin *m_shared_plugin;
+    static IBusEnginePlugin *m_trigger_plugin;
+    static guint m_trigger_idle_id;
 };
 
 };
@@ -25,14 +25,17 @@
 
 namespace PY {
 
+class String;
+
 class HalfFullConverter {
 
 public:
     static gunichar toFull (gunichar ch);
     static gunichar toHalf (gunichar ch);
 
-private:
-    const static guint m_table[][3];
+    /* convert an utf-8 string, and append the result to out */
+    static void toFull (const gchar *in, String &out);
+    static void toHalf (const gchar *in, String &out);
 };
 
 };
@@ -24,8 +24,12 @@
 #include <string.h>
 #include <pinyin.h>
 #include "PYPConfig.h"
+#include "PYDiagnostics.h"
+#include "PYTrace.h"
 
 #define LIBPINYIN_SAVE_TIMEOUT   (5 * 60)
+/* train synchronously rather than queue more instances than this. */
+#define LIBPINYIN_MAX_PENDING_TRAINING 4
 
 using namespace PY;
 
@@ -38,38 +42,74 @@ LibPinyinBackEnd::LibPinyinBackEnd () {
     m_timer = g_timer_new ();
     m_pinyin_context = NULL;
     m_chewing_context = NULL;
+    m_train_id = 0;
 }
 
+static void free_instance (pinyin_instance_t *instance);
+
 LibPinyinBackEnd::~LibPinyinBackEnd () {
+    if (m_train_id != 0)
+        g_source_remove (m_train_id);
+    flushTraining ();
+    for (auto instance : m_spare_pinyin_instances)
+        free_instance (instance);
+    for (auto instance : m_spare_chewing_instances)
+        free_instance (instance);
+
     g_timer_destroy (m_timer);
     if (m_timeout_id != 0) {
         saveUserDB ();
         g_source_remove (m_timeout_id);
     }
 
-    if (m_pinyin_context)
+    if (m_pinyin_context) {
         pinyin_fini(m_pinyin_context);
+        Diagnostics::unref (DIAG_PINYIN_CONTEXT);
+    }
     m_pinyin_context = NULL;
-    if (m_chewing_context)
+    if (m_chewing_context) {
         pinyin_fini(m_chewing_context);
+        Diagnostics::unref (DIAG_PINYIN_CONTEXT);
+    }
     m_chewing_context = NULL;
 }
 
+static pinyin_instance_t *
+alloc_instance (pinyin_context_t *context)
+{
+    pinyin_instance_t *instance = pinyin_alloc_instance (context);
+    if (instance)
+        Diagnostics::ref (DIAG_PINYIN_INSTANCE);
+    return instance;
+}
+
+static void
+free_instance (pinyin_instance_t *instance)
+{
+    pinyin_free_instance (instance);
+    Diagnostics::unref (DIAG_PINYIN_INSTANCE);
+}
+
 pinyin_context_t *
-LibPinyinBackEnd::initPinyinContext (Config *config)
+LibPinyinBackEnd::initContext (const gchar *name,
+                               const std::string & dictionaries)
 {
     pinyin_context_t * context = NULL;
 
+    std::string dirname = name;
+    dirname += m_user_suffix;
     gchar * userdir = g_build_filename (g_get_user_cache_dir (),
-                                        "ibus", "libpinyin", NULL);
+                                        "ibus", dirname.c_str (), NULL);
     int retval = g_mkdir_with_parents (userdir, 0700);
     if (retval) {
         g_free (userdir); userdir = NULL;
     }
     context = pinyin_init (LIBPINYIN_DATADIR, userdir);
+    if (context)
+        Diagnostics::ref (DIAG_PINYIN_CONTEXT);
     g_free (userdir);
 
-    const char *dicts = config->dictionaries ().c_str ();
+    const char *dicts = dictionaries.c_str ();
     gchar ** indices = g_strsplit_set (dicts, ";", -1);
     for (size_t i = 0; i < g_strv_length(indices); ++i) {
         int index = atoi (indices [i]);
@@ -83,6 +123,18 @@ LibPinyinBackEnd::initPinyinContext (Config *config)
     return context;
 }
 
+pinyin_context_t *
+LibPinyinBackEnd::initPinyinContext (Config *config)
+{
+    return initPinyinContext (config->dictionaries ());
+}
+
+pinyin_context_t *
+LibPinyinBackEnd::initPinyinContext (const std::string & dictionaries)
+{
+    return initContext ("libpinyin", dictionaries);
+}
+
 pinyin_instance_t *
 LibPinyinBackEnd::allocPinyinInstance ()
 {
@@ -92,41 +144,25 @@ LibPinyinBackEnd::allocPinyinInstance ()
     }
 
     setPinyinOptions (config);
-    return pinyin_alloc_instance (m_pinyin_context);
+    return alloc_instance (m_pinyin_context);
 }
 
 void
 LibPinyinBackEnd::freePinyinInstance (pinyin_instance_t *instance)
 {
-    pinyin_free_instance (instance);
+    free_instance (instance);
 }
 
 pinyin_context_t *
 LibPinyinBackEnd::initChewingContext (Config *config)
 {
-    pinyin_context_t * context = NULL;
-
-    gchar * userdir = g_build_filename (g_get_user_cache_dir (),
-                                        "ibus", "libbopomofo", NULL);
-    int retval = g_mkdir_with_parents (userdir, 0700);
-    if (retval) {
-        g_free(userdir); userdir = NULL;
-    }
-    context = pinyin_init (LIBPINYIN_DATADIR, userdir);
-    g_free(userdir);
-
-    const char *dicts = config->dictionaries ().c_str ();
-    gchar ** indices = g_strsplit_set (dicts, ";", -1);
-    for (size_t i = 0; i < g_strv_length(indices); ++i) {
-        int index = atoi (indices [i]);
-        if (index <= 1)
-            continue;
-
-        pinyin_load_addon_phrase_library (context, index);
-    }
-    g_strfreev (indices);
+    return initChewingContext (config->dictionaries ());
+}
 
-    return context;
+pinyin_context_t *
+LibPinyinBackEnd::initChewingContext (const std::string & dictionaries)
+{
+    return initContext ("libbopomofo", dictionaries);
 }
 
 pinyin_instance_t *
@@ -138,13 +174,39 @@ LibPinyinBackEnd::allocChewingInstance ()
     }
 
     setChewingOptions (config);
-    return pinyin_alloc_instance (m_chewing_context);
+    return alloc_instance (m_chewing_context);
 }
 
 void
 LibPinyinBackEnd::freeChewingInstance (pinyin_instance_t *instance)
 {
-    pinyin_free_instance (instance);
+    free_instance (instance);
+}
+
+pinyin_instance_t *
+LibPinyinBackEnd::allocPinyinInstance (const std::string & dictionaries,
+                                       pinyin_option_t options,
+                                       DoublePinyinScheme scheme)
+{
+    if (NULL == m_pinyin_context) {
+        m_pinyin_context = initPinyinContext (dictionaries);
+    }
+
+    setPinyinOptions (options, scheme);
+    return alloc_instance (m_pinyin_context);
+}
+
+pinyin_instance_t *
+LibPinyinBackEnd::allocChewingInstance (const std::string & dictionaries,
+                                        pinyin_option_t options,
+                                        ZhuyinScheme scheme)
+{
+    if (NULL == m_chewing_context) {
+        m_chewing_context = initChewingContext (dictionaries);
+    }
+
+    setChewingOptions (options, scheme);
+    return alloc_instance (m_chewing_context);
 }
 
 void
@@ -152,6 +214,36 @@ LibPinyinBackEnd::init (void) {
     g_assert (NULL == m_instance.get ());
     LibPinyinBackEnd * backend = new LibPinyinBackEnd;
     m_instance.reset (backend);
+
+    Diagnostics::addReporter (LibPinyinBackEnd::reportDiagnostics);
+}
+
+/* libpinyin has no memory statistics, the loaded tables
+ * are approximated by the size of their files. */
+void
+LibPinyinBackEnd::reportDiagnostics (String & output)
+{
+    LibPinyinBackEnd *backend = m_instance.get ();
+    if (backend == NULL)
+        return;
+
+    output.appendPrintf ("libpinyin: system tables ~%" G_GSIZE_FORMAT " KiB\n",
+                         Diagnostics::directorySize (LIBPINYIN_DATADIR) / 1024);
+
+    const gchar * const names[] = { "libpinyin", "libbopomofo" };
+    const pinyin_context_t * const contexts[] =
+        { backend->m_pinyin_context, backend->m_chewing_context };
+    for (guint i = 0; i < G_N_ELEMENTS (names); i++) {
+        if (contexts[i] == NULL)
+            continue;
+        std::string dirname = names[i];
+        dirname += backend->m_user_suffix;
+        gchar *userdir = g_build_filename (g_get_user_cache_dir (),
+                                           "ibus", dirname.c_str (), NULL);
+        output.appendPrintf ("  %s context: user tables ~%" G_GSIZE_FORMAT " KiB\n",
+                             names[i], Diagnostics::directorySize (userdir) / 1024);
+        g_free (userdir);
+    }
 }
 
 void
@@ -161,29 +253,42 @@ LibPinyinBackEnd::finalize (void) {
 
 gboolean
 LibPinyinBackEnd::setPinyinOptions (Config *config)
+{
+    return setPinyinOptions (config->option (),
+                             config->doublePinyinSchema ());
+}
+
+gboolean
+LibPinyinBackEnd::setPinyinOptions (pinyin_option_t options,
+                                    DoublePinyinScheme scheme)
 {
     if (NULL == m_pinyin_context)
         return FALSE;
 
-    DoublePinyinScheme scheme = config->doublePinyinSchema ();
     pinyin_set_double_pinyin_scheme (m_pinyin_context, scheme);
 
-    pinyin_option_t options = config->option()
-        | USE_RESPLIT_TABLE | USE_DIVIDED_TABLE;
+    options |= USE_RESPLIT_TABLE | USE_DIVIDED_TABLE;
     pinyin_set_options (m_pinyin_context, options);
     return TRUE;
 }
 
 gboolean
 LibPinyinBackEnd::setChewingOptions (Config *config)
+{
+    return setChewingOptions (config->option (),
+                              config->bopomofoKeyboardMapping ());
+}
+
+gboolean
+LibPinyinBackEnd::setChewingOptions (pinyin_option_t options,
+                                     ZhuyinScheme scheme)
 {
     if (NULL == m_chewing_context)
         return FALSE;
 
-    ZhuyinScheme scheme = config->bopomofoKeyboardMapping ();
     pinyin_set_zhuyin_scheme (m_chewing_context, scheme);
 
-    pinyin_option_t options = config->option() | USE_TONE;
+    options |= USE_TONE;
     pinyin_set_options(m_chewing_context, options);
     return TRUE;
 }
@@ -255,6 +360,8 @@ LibPinyinBackEnd::importPinyinDictionary (const char * filename)
 gboolean
 LibPinyinBackEnd::exportPinyinDictionary (const char * filename)
 {
+    flushTraining ();
+
     /* user phrase library should be already loaded here. */
     FILE * dictfile = fopen (filename, "w");
     if (NULL == dictfile)
@@ -291,6 +398,9 @@ LibPinyinBackEnd::exportPinyinDictionary (const char * filename)
 gboolean
 LibPinyinBackEnd::clearPinyinUserData (const char * target)
 {
+    /* queued training must not come back after the clearing. */
+    flushTraining ();
+
     if (0 == strcmp ("all", target)) {
         pinyin_mask_out (m_pinyin_context, 0x0, 0x0);
     } else if (0 == strcmp ("user", target)) {
@@ -323,6 +433,93 @@ LibPinyinBackEnd::rememberUserInput (pinyin_instance_t * instance,
     return TRUE;
 }
 
+pinyin_instance_t *
+LibPinyinBackEnd::trainPinyinInstance (pinyin_instance_t *instance,
+                                       gint index, gboolean remember)
+{
+    return deferTraining (instance, index, remember, FALSE);
+}
+
+pinyin_instance_t *
+LibPinyinBackEnd::trainChewingInstance (pinyin_instance_t *instance,
+                                        gint index, gboolean remember)
+{
+    return deferTraining (instance, index, remember, TRUE);
+}
+
+pinyin_instance_t *
+LibPinyinBackEnd::deferTraining (pinyin_instance_t *instance,
+                                 gint index, gboolean remember,
+                                 gboolean chewing)
+{
+    if (m_pending_training.size () >= LIBPINYIN_MAX_PENDING_TRAINING)
+        flushTraining ();
+
+    /* the committed instance itself is the snapshot, its keys and
+       constraints stay untouched until the training is done. */
+    std::vector<pinyin_instance_t *> & spares = chewing ?
+        m_spare_chewing_instances : m_spare_pinyin_instances;
+    pinyin_instance_t *replacement = NULL;
+    if (!spares.empty ()) {
+        replacement = spares.back ();
+        spares.pop_back ();
+    } else {
+        replacement = alloc_instance
+            (chewing ? m_chewing_context : m_pinyin_context);
+    }
+
+    PendingTraining training = { instance, index, remember, chewing };
+    m_pending_training.push_back (training);
+
+    if (replacement == NULL) {
+        /* nothing to swap in, train right away as before. */
+        flushTraining ();
+        replacement = spares.back ();
+        spares.pop_back ();
+        return replacement;
+    }
+
+    if (m_train_id == 0)
+        m_train_id = g_idle_add (LibPinyinBackEnd::trainCallback,
+                                 static_cast<gpointer> (this));
+    return replacement;
+}
+
+void
+LibPinyinBackEnd::flushTraining (void)
+{
+    if (m_pending_training.empty ())
+        return;
+
+    for (auto & training : m_pending_training) {
+        {
+            PY_TRACE ("pinyin_train", "libpinyin");
+            pinyin_train (training.instance, training.index);
+        }
+        if (training.remember)
+            rememberUserInput (training.instance, training.index);
+
+        pinyin_reset (training.instance);
+        if (training.chewing)
+            m_spare_chewing_instances.push_back (training.instance);
+        else
+            m_spare_pinyin_instances.push_back (training.instance);
+    }
+    m_pending_training.clear ();
+
+    modified ();
+}
+
+gboolean
+LibPinyinBackEnd::trainCallback (gpointer data)
+{
+    LibPinyinBackEnd *self = static_cast<LibPinyinBackEnd *> (data);
+
+    self->m_train_id = 0;
+    self->flushTraining ();
+    return FALSE;
+}
+
 gboolean
 LibPinyinBackEnd::timeoutCallback (gpointer data)
 {
@@ -343,6 +540,7 @@ LibPinyinBackEnd::timeoutCallback (gpointer data)
 gboolean
 LibPinyinBackEnd::saveUserDB (void)
 {
+    PY_TRACE ("pinyin_save", "libpinyin");
     if (m_pinyin_context)
         pinyin_save (m_pinyin_context);
     if (m_chewing_context)
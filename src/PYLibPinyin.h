@@ -23,7 +23,11 @@
 #define __PY_LIB_PINYIN_H_
 
 #include <memory>
+#include <string>
+#include <vector>
 #include <glib.h>
+#include <pinyin.h>
+#include "PYString.h"
 
 typedef struct _pinyin_context_t pinyin_context_t;
 typedef struct _pinyin_instance_t pinyin_instance_t;
@@ -40,32 +44,66 @@ public:
 
     gboolean setPinyinOptions (Config *config);
     gboolean setChewingOptions (Config *config);
+    gboolean setPinyinOptions (pinyin_option_t options,
+                               DoublePinyinScheme scheme);
+    gboolean setChewingOptions (pinyin_option_t options,
+                                ZhuyinScheme scheme);
 
     pinyin_context_t * initPinyinContext (Config *config);
     pinyin_context_t * initChewingContext (Config *config);
+    pinyin_context_t * initPinyinContext (const std::string & dictionaries);
+    pinyin_context_t * initChewingContext (const std::string & dictionaries);
 
     pinyin_instance_t *allocPinyinInstance ();
     void freePinyinInstance (pinyin_instance_t *instance);
     pinyin_instance_t *allocChewingInstance ();
     void freeChewingInstance (pinyin_instance_t *instance);
+
+    /* allocate without ibus config, e.g. in batch mode. */
+    pinyin_instance_t *allocPinyinInstance (const std::string & dictionaries,
+                                            pinyin_option_t options,
+                                            DoublePinyinScheme scheme);
+    pinyin_instance_t *allocChewingInstance (const std::string & dictionaries,
+                                             pinyin_option_t options,
+                                             ZhuyinScheme scheme);
     void modified (void);
 
+    /* keep the user tables in "libpinyin<suffix>" and "libbopomofo<suffix>"
+       of the user cache directory, set before the contexts are loaded. */
+    void setUserDirectorySuffix (const gchar *suffix) { m_user_suffix = suffix; }
+
     gboolean importPinyinDictionary (const char * filename);
     gboolean exportPinyinDictionary (const char * filename);
     gboolean clearPinyinUserData (const char * target);
 
     gboolean rememberUserInput (pinyin_instance_t * instance, gint index);
 
+    /* hand over a committed instance to be trained from an idle
+       callback, and get back an instance to keep typing with. */
+    pinyin_instance_t *trainPinyinInstance (pinyin_instance_t *instance,
+                                            gint index, gboolean remember);
+    pinyin_instance_t *trainChewingInstance (pinyin_instance_t *instance,
+                                             gint index, gboolean remember);
+    void flushTraining (void);
+
     /* use static initializer in C++. */
     static LibPinyinBackEnd & instance (void) { return *m_instance; }
 
     static void init (void);
     static void finalize (void);
 
+    static void reportDiagnostics (String & output);
+
 
 private:
+    pinyin_context_t * initContext (const gchar *name,
+                                    const std::string & dictionaries);
     gboolean saveUserDB (void);
+    pinyin_instance_t *deferTraining (pinyin_instance_t *instance,
+                                      gint index, gboolean remember,
+                                      gboolean chewing);
     static gboolean timeoutCallback (gpointer data);
+    static gboolean trainCallback (gpointer data);
 
 private:
     /* libpinyin context */
@@ -74,6 +112,21 @@ private:
 
     guint m_timeout_id;
     GTimer *m_timer;
+    std::string m_user_suffix;
+
+    struct PendingTraining {
+        pinyin_instance_t *instance;
+        gint index;
+        gboolean remember;
+        gboolean chewing;
+    };
+
+    /* committed instances waiting for training, and reset ones
+       ready to be swapped into the editors. */
+    std::vector<PendingTraining> m_pending_training;
+    std::vector<pinyin_instance_t *> m_spare_pinyin_instances;
+    std::vector<pinyin_instance_t *> m_spare_chewing_instances;
+    guint m_train_id;
 
 private:
     static std::unique_ptr<LibPinyinBackEnd> m_instance;
@@ -32,6 +32,17 @@
 #include "PYConfig.h"
 #include "PYPConfig.h"
 #include "PYLibPinyin.h"
+#include "PYBatchConverter.h"
+#include "PYServer.h"
+#include "PYSpecialPhraseTable.h"
+#include "PYDiagnostics.h"
+#include "PYTrace.h"
+#ifdef IBUS_BUILD_LUA_EXTENSION
+extern "C" {
+#include "lua-plugin.h"
+}
+#include "PYExtEditor.h"
+#endif
 
 using namespace PY;
 
@@ -42,6 +53,29 @@ static Pointer<IBusFactory> factory;
 /* options */
 static gboolean ibus = FALSE;
 static gboolean verbose = FALSE;
+static gboolean batch = FALSE;
+static gchar *batch_input = NULL;
+static gchar *batch_scheme = NULL;
+static gint batch_nbest = 1;
+static gchar *batch_dictionaries = NULL;
+static gint batch_threads = 1;
+static gboolean batch_benchmark = FALSE;
+static gchar *server_path = NULL;
+static gint server_connections = 16;
+static gboolean stats = FALSE;
+static gchar *trace_filename = NULL;
+#ifdef IBUS_BUILD_LUA_EXTENSION
+static gboolean shared_lua = FALSE;
+#endif
+
+#ifdef IBUS_BUILD_LUA_EXTENSION
+/* the lua calls run on the worker threads of the plugins. */
+static void
+trace_lua_call (const char *name, gint64 start, gint64 duration)
+{
+    Trace::complete (name, "lua", start, duration);
+}
+#endif
 
 static void
 show_version_and_quit (void)
@@ -56,6 +90,32 @@ static const GOptionEntry entries[] =
         (gpointer) show_version_and_quit, "Show the application's version.", NULL },
     { "ibus",    'i', 0, G_OPTION_ARG_NONE, &ibus, "component is executed by ibus", NULL },
     { "verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose, "verbose", NULL },
+    { "batch",   'b', 0, G_OPTION_ARG_NONE, &batch,
+        "convert lines from stdin or --input without ibus", NULL },
+    { "input",   0, 0, G_OPTION_ARG_FILENAME, &batch_input,
+        "read batch input from FILE", "FILE" },
+    { "scheme",  0, 0, G_OPTION_ARG_STRING, &batch_scheme,
+        "batch input scheme: pinyin, double_pinyin or bopomofo", "SCHEME" },
+    { "nbest",   0, 0, G_OPTION_ARG_INT, &batch_nbest,
+        "write up to N sentences for each line", "N" },
+    { "dictionaries", 0, 0, G_OPTION_ARG_STRING, &batch_dictionaries,
+        "addon dictionaries of batch and server mode, like \"2;3\"", "LIST" },
+    { "threads", 'j', 0, G_OPTION_ARG_INT, &batch_threads,
+        "convert with N threads, 0 for one per cpu", "N" },
+    { "benchmark", 0, 0, G_OPTION_ARG_NONE, &batch_benchmark,
+        "measure batch speed from 1 to --threads threads", NULL },
+    { "server",  0, 0, G_OPTION_ARG_FILENAME, &server_path,
+        "serve conversions on the UNIX socket PATH", "PATH" },
+    { "connections", 0, 0, G_OPTION_ARG_INT, &server_connections,
+        "serve up to N connections at the same time", "N" },
+    { "stats",   0, 0, G_OPTION_ARG_NONE, &stats,
+        "print the diagnostics report on exit, also sent on SIGUSR2", NULL },
+    { "trace",   0, 0, G_OPTION_ARG_FILENAME, &trace_filename,
+        "write trace events in the chrome trace format to FILE", "FILE" },
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    { "shared-lua", 0, 0, G_OPTION_ARG_NONE, &shared_lua,
+        "share one lua state between all input contexts", NULL },
+#endif
     { NULL },
 };
 
@@ -88,6 +148,7 @@ start_component (void)
     }
 
     LibPinyinBackEnd::init ();
+    SpecialPhraseTable::init ();
 
     PinyinConfig::init (bus);
     BopomofoConfig::init (bus);
@@ -147,6 +208,7 @@ start_component (void)
 static void
 sigterm_cb (int sig)
 {
+    Trace::finalize ();
     LibPinyinBackEnd::finalize ();
 
     ::exit (EXIT_FAILURE);
@@ -155,6 +217,10 @@ sigterm_cb (int sig)
 static void
 atexit_cb (void)
 {
+    if (stats)
+        Diagnostics::dump ();
+    Trace::finalize ();
+    SpecialPhraseTable::finalize ();
     LibPinyinBackEnd::finalize ();
 }
 
@@ -179,10 +245,43 @@ main (gint argc, gchar **argv)
         exit (-1);
     }
 
+    Trace::init (trace_filename);
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    if (Trace::enabled ())
+        ibus_engine_plugin_set_trace_func (trace_lua_call);
+#endif
+
     ::signal (SIGTERM, sigterm_cb);
     ::signal (SIGINT, sigterm_cb);
     g_atexit (atexit_cb);
 
+    if (batch) {
+        BatchOptions options;
+        options.input = batch_input;
+        options.scheme = batch_scheme;
+        options.nbest = batch_nbest;
+        options.dictionaries = batch_dictionaries;
+        options.threads = batch_threads;
+        options.benchmark = batch_benchmark;
+
+        return batch_convert (options);
+    }
+
+    if (server_path) {
+        ServerOptions options;
+        options.path = server_path;
+        options.dictionaries = batch_dictionaries;
+        options.max_connections = MAX (server_connections, 1);
+
+        LibPinyinBackEnd::init ();
+        Diagnostics::init ();
+        return server_run (options);
+    }
+
+    Diagnostics::init ();
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    ExtEditor::setSharedPlugin (shared_lua);
+#endif
     start_component ();
     return 0;
 }
@@ -25,6 +25,7 @@
 #include "PYPinyinProperties.h"
 #include "PYSimpTradConverter.h"
 #include "PYHalfFullConverter.h"
+#include "PYTrace.h"
 
 
 using namespace PY;
@@ -240,6 +241,7 @@ BopomofoEditor::processKeyEvent (guint keyval, guint keycode,
 void
 BopomofoEditor::updatePinyin (void)
 {
+    PY_TRACE ("BopomofoEditor::updatePinyin", "libpinyin");
     if (G_UNLIKELY (m_text.empty ())) {
         m_pinyin_len = 0;
         /* TODO: check whether to replace "" with NULL. */
@@ -291,17 +293,17 @@ BopomofoEditor::commit (gint index)
         ++p;
     }
 
-    pinyin_train(m_instance, index);
-    if (m_config.rememberEveryInput ())
-        LibPinyinBackEnd::instance ().rememberUserInput (m_instance, index);
-    LibPinyinBackEnd::instance ().modified();
     PhoneticEditor::commit ((const gchar *)m_buffer);
+    /* learn from the committed instance after the text is delivered. */
+    m_instance = LibPinyinBackEnd::instance ().trainChewingInstance
+        (m_instance, index, m_config.rememberEveryInput ());
     reset();
 }
 
 void
 BopomofoEditor::updatePreeditText ()
 {
+    PY_TRACE ("BopomofoEditor::updatePreeditText", "editor");
     /* preedit text = guessed sentence + un-parsed pinyin text */
     if (G_UNLIKELY (m_text.empty ())) {
         hidePreeditText ();
@@ -339,6 +341,7 @@ BopomofoEditor::updatePreeditText ()
 void
 BopomofoEditor::updateAuxiliaryText (void)
 {
+    PY_TRACE ("BopomofoEditor::updateAuxiliaryText", "editor");
     if (G_UNLIKELY (m_text.empty ())) {
         hideAuxiliaryText ();
         return;
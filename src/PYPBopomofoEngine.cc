@@ -27,6 +27,7 @@
 #include "PYFallbackEditor.h"
 #include "PYConfig.h"
 #include "PYPConfig.h"
+#include "PYDiagnostics.h"
 
 using namespace PY;
 
@@ -36,7 +37,9 @@ BopomofoEngine::BopomofoEngine (IBusEngine *engine)
       m_props (BopomofoConfig::instance ()),
       m_prev_pressed_key (IBUS_VoidSymbol),
       m_input_mode (MODE_INIT),
-      m_fallback_editor (new FallbackEditor (m_props, BopomofoConfig::instance()))
+      m_fallback_editor (new FallbackEditor (m_props, BopomofoConfig::instance())),
+      m_content_type_policy (CONTENT_TYPE_POLICY_NORMAL),
+      m_forced_english (FALSE)
 {
     gint i;
 
@@ -52,11 +55,15 @@ BopomofoEngine::BopomofoEngine (IBusEngine *engine)
     }
 
     connectEditorSignals (m_fallback_editor);
+
+    m_diagnostics_id = Diagnostics::addReporter
+        (std::bind (&BopomofoEngine::reportDiagnostics, this, _1));
 }
 
 /* destructor */
 BopomofoEngine::~BopomofoEngine (void)
 {
+    Diagnostics::removeReporter (m_diagnostics_id);
 }
 
 /* keep synced with pinyin engine. */
@@ -64,11 +71,13 @@ gboolean
 BopomofoEngine::processAccelKeyEvent (guint keyval, guint keycode,
                                       guint modifiers)
 {
-    std::string accel;
-    pinyin_accelerator_name (keyval, modifiers, accel);
+    const PinyinConfig & config = PinyinConfig::instance ();
+    guint accel_keyval = keyval;
+    guint accel_modifiers = modifiers;
+    pinyin_accelerator_normalize (accel_keyval, accel_modifiers);
 
     /* Safe Guard for empty key. */
-    if ("" == accel)
+    if (0 == accel_keyval && 0 == accel_modifiers)
         return FALSE;
 
     /* check Shift or Ctrl + Release hotkey,
@@ -79,7 +88,7 @@ BopomofoEngine::processAccelKeyEvent (guint keyval, guint keycode,
         gboolean triggered = FALSE;
 
         if (m_prev_pressed_key == keyval) {
-            if (PinyinConfig::instance ().mainSwitch () == accel) {
+            if (config.mainSwitchAccel ().match (accel_keyval, accel_modifiers)) {
                 triggered = TRUE;
             }
         }
@@ -102,21 +111,21 @@ BopomofoEngine::processAccelKeyEvent (guint keyval, guint keycode,
     }
 
     /* Toggle full/half Letter Mode */
-    if (PinyinConfig::instance (). letterSwitch () == accel) {
+    if (config.letterSwitchAccel ().match (accel_keyval, accel_modifiers)) {
         m_props.toggleModeFull ();
         m_prev_pressed_key = keyval;
         return TRUE;
     }
 
     /* Toggle full/half Punct Mode */
-    if (PinyinConfig::instance (). punctSwitch () == accel) {
+    if (config.punctSwitchAccel ().match (accel_keyval, accel_modifiers)) {
         m_props.toggleModeFullPunct ();
         m_prev_pressed_key = keyval;
         return TRUE;
     }
 
     /* Toggle simp/trad Chinese Mode */
-    if (PinyinConfig::instance ().tradSwitch () == accel) {
+    if (config.tradSwitchAccel ().match (accel_keyval, accel_modifiers)) {
         m_props.toggleModeSimp ();
         m_prev_pressed_key = keyval;
         return TRUE;
@@ -133,6 +142,9 @@ BopomofoEngine::processKeyEvent (guint keyval, guint keycode, guint modifiers)
     if (contentIsPassword ())
         return retval;
 
+    if (m_content_type_policy == CONTENT_TYPE_POLICY_PASSTHROUGH)
+        return retval;
+
     if (processAccelKeyEvent (keyval, keycode, modifiers))
         return TRUE;
 
@@ -140,7 +152,8 @@ BopomofoEngine::processKeyEvent (guint keyval, guint keycode, guint modifiers)
     if (modifiers & IBUS_RELEASE_MASK)
         return FALSE;
 
-    if (m_props.modeChinese ()) {
+    if (m_props.modeChinese () &&
+        m_content_type_policy != CONTENT_TYPE_POLICY_FALLBACK) {
         if (G_UNLIKELY (m_input_mode == MODE_INIT &&
                         m_editors[MODE_INIT]->text ().empty () &&
                         cmshm_filter (modifiers) == 0 &&
@@ -176,17 +189,54 @@ void
 BopomofoEngine::focusOut (void)
 {
     Engine::focusOut ();
+    applyContentTypePolicy (CONTENT_TYPE_POLICY_NORMAL);
 
     reset ();
 }
 
+#if IBUS_CHECK_VERSION (1, 5, 4)
+void
+BopomofoEngine::setContentType (guint purpose, guint hints)
+{
+    Engine::setContentType (purpose, hints);
+    applyContentTypePolicy (BopomofoConfig::instance ().contentTypePolicy (purpose));
+}
+#endif
+
+void
+BopomofoEngine::applyContentTypePolicy (ContentTypePolicy policy)
+{
+    m_content_type_policy = policy;
+
+    if (policy == CONTENT_TYPE_POLICY_ENGLISH) {
+        if (m_props.modeChinese ()) {
+            reset ();
+            m_props.toggleModeChinese ();
+            m_forced_english = TRUE;
+        }
+    }
+    else if (m_forced_english) {
+        /* restore chinese mode, unless the user already did. */
+        if (!m_props.modeChinese ())
+            m_props.toggleModeChinese ();
+        m_forced_english = FALSE;
+    }
+}
+
 void
 BopomofoEngine::reset (void)
 {
+    gint active_mode = m_input_mode;
+
     m_prev_pressed_key = IBUS_VoidSymbol;
     m_input_mode = MODE_INIT;
+    /* only the active editor and editors holding input need a reset,
+     * resetting the others just sends redundant hide signals. */
     for (gint i = 0; i < MODE_LAST; i++) {
-        m_editors[i]->reset ();
+        if (!m_editors[i])
+            continue;
+        if (i == active_mode || m_editors[i]->dirty ())
+            m_editors[i]->reset ();
     }
     m_fallback_editor->reset ();
 }
@@ -200,6 +250,9 @@ BopomofoEngine::enable (void)
 void
 BopomofoEngine::disable (void)
 {
+    /* ibus hides the preedit, auxiliary text and lookup table
+     * of a disabled engine by itself. */
+    invalidateFrame ();
 }
 
 void
@@ -256,6 +309,24 @@ BopomofoEngine::candidateClicked (guint index,
     m_editors[m_input_mode]->candidateClicked (index, button, state);
 }
 
+void
+BopomofoEngine::reportDiagnostics (String & output)
+{
+    static const gchar * const names[MODE_LAST] = { "init", "punct" };
+    gsize total = m_fallback_editor->memoryUsage ();
+
+    output.appendPrintf ("bopomofo engine %p:\n", this);
+    for (gint i = MODE_INIT; i < MODE_LAST; i++) {
+        if (!m_editors[i])
+            continue;
+        gsize size = m_editors[i]->memoryUsage ();
+        output.appendPrintf ("  %s editor: %" G_GSIZE_FORMAT " bytes\n",
+                             names[i], size);
+        total += size;
+    }
+    output.appendPrintf ("  total: %" G_GSIZE_FORMAT " bytes\n", total);
+}
+
 void
 BopomofoEngine::commitText (Text & text)
 {
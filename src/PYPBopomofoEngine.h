@@ -24,6 +24,7 @@
 #define __PY_LIB_PINYIN_BOPOMOFO_ENGINE_H_
 
 #include "PYEngine.h"
+#include "PYConfig.h"
 #include "PYPinyinProperties.h"
 
 namespace PY {
@@ -39,6 +40,9 @@ public:
     gboolean processKeyEvent (guint keyval, guint keycode, guint modifiers);
     void focusIn (void);
     void focusOut (void);
+#if IBUS_CHECK_VERSION (1, 5, 4)
+    void setContentType (guint purpose, guint hints);
+#endif
     void reset (void);
     void enable (void);
     void disable (void);
@@ -55,9 +59,11 @@ private:
 private:
     void showSetupDialog (void);
     void connectEditorSignals (EditorPtr editor);
+    void applyContentTypePolicy (ContentTypePolicy policy);
 
 private:
     void commitText (Text & text);
+    void reportDiagnostics (String & output);
 
 private:
     PinyinProperties m_props;
@@ -78,6 +84,10 @@ private:
 
     EditorPtr m_editors[MODE_LAST];
     EditorPtr m_fallback_editor;
+
+    ContentTypePolicy m_content_type_policy;
+    gboolean m_forced_english;      // english mode set by the policy
+    guint m_diagnostics_id;
 };
 
 };
@@ -24,6 +24,7 @@
 #include <pinyin.h>
 #include "PYBus.h"
 #include "PYLibPinyin.h"
+#include "PYPPinyinEditor.h"
 
 
 namespace PY {
@@ -37,6 +38,7 @@ const gchar * const CONFIG_SHIFT_SELECT_CANDIDATE    = "shift_select_candidate";
 const gchar * const CONFIG_MINUS_EQUAL_PAGE          = "minus_equal_page";
 const gchar * const CONFIG_COMMA_PERIOD_PAGE         = "comma_period_page";
 const gchar * const CONFIG_AUTO_COMMIT               = "auto_commit";
+const gchar * const CONFIG_STREAMING_COMMIT_LENGTH   = "streaming_commit_length";
 const gchar * const CONFIG_DOUBLE_PINYIN             = "double_pinyin";
 const gchar * const CONFIG_DOUBLE_PINYIN_SCHEMA      = "double_pinyin_schema";
 const gchar * const CONFIG_DOUBLE_PINYIN_SHOW_RAW    = "double_pinyin_show_raw";
@@ -52,6 +54,8 @@ const gchar * const CONFIG_GUIDE_KEY                 = "guide_key";
 const gchar * const CONFIG_AUXILIARY_SELECT_KEY_F    = "auxiliary_select_key_f";
 const gchar * const CONFIG_AUXILIARY_SELECT_KEY_KP   = "auxiliary_select_key_kp";
 const gchar * const CONFIG_ENTER_KEY                 = "enter_key";
+const gchar * const CONFIG_EDITOR_IDLE_TIMEOUT       = "editor_idle_timeout";
+const gchar * const CONFIG_CONTENT_TYPE_POLICY       = "content_type_policy";
 const gchar * const CONFIG_IMPORT_DICTIONARY         = "import_dictionary";
 const gchar * const CONFIG_EXPORT_DICTIONARY         = "export_dictionary";
 const gchar * const CONFIG_CLEAR_USER_DATA           = "clear_user_data";
@@ -80,6 +84,12 @@ LibPinyinConfig::LibPinyinConfig (Bus & bus, const std::string & name)
                       this);
 }
 
+LibPinyinConfig::LibPinyinConfig (const std::string & name)
+    : Config (name)
+{
+    initDefaultValues ();
+}
+
 LibPinyinConfig::~LibPinyinConfig (void)
 {
 }
@@ -98,6 +108,7 @@ LibPinyinConfig::initDefaultValues (void)
     m_minus_equal_page = TRUE;
     m_comma_period_page = TRUE;
     m_auto_commit = FALSE;
+    m_streaming_commit_length = 0;
 
     m_double_pinyin = FALSE;
     m_double_pinyin_schema = DOUBLE_PINYIN_DEFAULT;
@@ -113,10 +124,14 @@ LibPinyinConfig::initDefaultValues (void)
 
     m_dictionaries = "";
 
+    m_editor_idle_timeout = 600;
+    parseContentTypePolicy (CONTENT_TYPE_POLICY_DEFAULT);
+
     m_main_switch = "<Shift>";
     m_letter_switch = "";
     m_punct_switch = "<Control>period";
     m_trad_switch = "<Control><Shift>f";
+    parseAccelerators ();
 }
 
 static const struct {
@@ -186,10 +201,19 @@ LibPinyinConfig::readDefaultValues (void)
 
     m_dictionaries = read (CONFIG_DICTIONARIES, std::string (""));
 
+    m_editor_idle_timeout = read (CONFIG_EDITOR_IDLE_TIMEOUT, 600);
+    if (m_editor_idle_timeout > 86400) {
+        m_editor_idle_timeout = 600;
+        g_warn_if_reached ();
+    }
+    parseContentTypePolicy
+        (read (CONFIG_CONTENT_TYPE_POLICY, CONTENT_TYPE_POLICY_DEFAULT));
+
     m_main_switch = read (CONFIG_MAIN_SWITCH, std::string ("<Shift>"));
     m_letter_switch = read (CONFIG_LETTER_SWITCH, std::string (""));
     m_punct_switch = read (CONFIG_PUNCT_SWITCH, std::string ("<Control>period"));
     m_trad_switch = read (CONFIG_TRAD_SWITCH, std::string ("<Control><Shift>f"));
+    parseAccelerators ();
 
     /* fuzzy pinyin */
     if (read (CONFIG_FUZZY_PINYIN, false))
@@ -237,14 +261,27 @@ LibPinyinConfig::valueChanged (const std::string &section,
         m_remember_every_input = normalizeGVariant (value, false);
     } else if (CONFIG_DICTIONARIES == name) {
         m_dictionaries = normalizeGVariant (value, std::string (""));
+    } else if (CONFIG_EDITOR_IDLE_TIMEOUT == name) {
+        m_editor_idle_timeout = normalizeGVariant (value, 600);
+        if (m_editor_idle_timeout > 86400) {
+            m_editor_idle_timeout = 600;
+            g_warn_if_reached ();
+        }
+    } else if (CONFIG_CONTENT_TYPE_POLICY == name) {
+        parseContentTypePolicy
+            (normalizeGVariant (value, std::string (CONTENT_TYPE_POLICY_DEFAULT)));
     } else if (CONFIG_MAIN_SWITCH == name) {
         m_main_switch = normalizeGVariant (value, std::string ("<Shift>"));
+        parseAccelerators ();
     } else if (CONFIG_LETTER_SWITCH == name) {
         m_letter_switch = normalizeGVariant (value, std::string (""));
+        parseAccelerators ();
     } else if (CONFIG_PUNCT_SWITCH == name) {
         m_punct_switch = normalizeGVariant (value, std::string ("<Control>period"));
+        parseAccelerators ();
     } else if (CONFIG_TRAD_SWITCH == name) {
         m_trad_switch = normalizeGVariant (value, std::string ("<Control><Shift>f"));
+        parseAccelerators ();
     }
     /* fuzzy pinyin */
     else if (CONFIG_FUZZY_PINYIN == name) {
@@ -321,6 +358,11 @@ PinyinConfig::PinyinConfig (Bus & bus)
 {
 }
 
+PinyinConfig::PinyinConfig (void)
+    : LibPinyinConfig ("libpinyin")
+{
+}
+
 void
 PinyinConfig::init (Bus & bus)
 {
@@ -330,6 +372,13 @@ PinyinConfig::init (Bus & bus)
     }
 }
 
+void
+PinyinConfig::init (void)
+{
+    if (m_instance.get () == NULL)
+        m_instance.reset (new PinyinConfig ());
+}
+
 void
 PinyinConfig::readDefaultValues (void)
 {
@@ -363,6 +412,11 @@ PinyinConfig::readDefaultValues (void)
     m_minus_equal_page = read (CONFIG_MINUS_EQUAL_PAGE, true);
     m_comma_period_page = read (CONFIG_COMMA_PERIOD_PAGE, true);
     m_auto_commit = read (CONFIG_AUTO_COMMIT, false);
+    m_streaming_commit_length = read (CONFIG_STREAMING_COMMIT_LENGTH, 0);
+    if (m_streaming_commit_length >= MAX_PINYIN_LEN) {
+        m_streaming_commit_length = 0;
+        g_warn_if_reached ();
+    }
 
     /* correct pinyin */
     if (read (CONFIG_CORRECT_PINYIN, true))
@@ -428,6 +482,13 @@ PinyinConfig::valueChanged (const std::string &section,
         m_comma_period_page = normalizeGVariant (value, true);
     else if (CONFIG_AUTO_COMMIT == name)
         m_auto_commit = normalizeGVariant (value, false);
+    else if (CONFIG_STREAMING_COMMIT_LENGTH == name) {
+        m_streaming_commit_length = normalizeGVariant (value, 0);
+        if (m_streaming_commit_length >= MAX_PINYIN_LEN) {
+            m_streaming_commit_length = 0;
+            g_warn_if_reached ();
+        }
+    }
     else if (CONFIG_IMPORT_DICTIONARY == name) {
         std::string filename = normalizeGVariant (value, std::string(""));
         LibPinyinBackEnd::instance ().importPinyinDictionary (filename.c_str ());
@@ -39,6 +39,7 @@ class Bus;
 class LibPinyinConfig : public Config {
 protected:
     LibPinyinConfig (Bus & bus, const std::string & name);
+    explicit LibPinyinConfig (const std::string & name);
     virtual ~LibPinyinConfig (void);
 
 public:
@@ -64,10 +65,13 @@ protected:
 class PinyinConfig : public LibPinyinConfig {
 public:
     static void init (Bus & bus);
+    /* the defaults, without ibus, e.g. in tests. */
+    static void init (void);
     static PinyinConfig & instance (void) { return *m_instance; }
 
 protected:
     PinyinConfig (Bus & bus);
+    PinyinConfig (void);
     virtual void readDefaultValues (void);
 
     virtual gboolean valueChanged (const std::string &section,
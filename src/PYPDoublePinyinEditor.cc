@@ -22,6 +22,7 @@
 #include "PYPDoublePinyinEditor.h"
 #include "PYConfig.h"
 #include "PYLibPinyin.h"
+#include "PYTrace.h"
 
 using namespace PY;
 
@@ -103,6 +104,7 @@ DoublePinyinEditor::processKeyEvent (guint keyval, guint keycode,
 void
 DoublePinyinEditor::updatePinyin (void)
 {
+    PY_TRACE ("DoublePinyinEditor::updatePinyin", "libpinyin");
     if (G_UNLIKELY (m_text.empty ())) {
         m_pinyin_len = 0;
         /* TODO: check whether to replace "" with NULL. */
@@ -120,6 +122,7 @@ DoublePinyinEditor::updatePinyin (void)
 void
 DoublePinyinEditor::updateAuxiliaryText (void)
 {
+    PY_TRACE ("DoublePinyinEditor::updateAuxiliaryText", "editor");
     if (G_UNLIKELY (m_text.empty ())) {
         hideAuxiliaryText ();
         return;
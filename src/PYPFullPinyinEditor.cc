@@ -22,6 +22,10 @@
 #include "PYPFullPinyinEditor.h"
 #include "PYConfig.h"
 #include "PYLibPinyin.h"
+#include "PYPinyinProperties.h"
+#include "PYSimpTradConverter.h"
+#include "PYSpecialPhraseTable.h"
+#include "PYTrace.h"
 
 using namespace PY;
 
@@ -41,19 +45,26 @@ FullPinyinEditor::~FullPinyinEditor (void)
 void
 FullPinyinEditor::reset (void)
 {
+    m_recent_sentences.clear ();
+    m_recent_text.clear ();
     PinyinEditor::reset ();
 }
 
 gboolean
 FullPinyinEditor::insert (gint ch)
 {
-    /* is full */
-    if (G_UNLIKELY (m_text.length () >= MAX_PINYIN_LEN))
-        return TRUE;
+    /* is full, with streaming commits make room by committing
+       a head of the input, otherwise drop the key. */
+    if (G_UNLIKELY (m_text.length () >= MAX_PINYIN_LEN)) {
+        if (m_config.streamingCommitLength () == 0)
+            return TRUE;
+        commitFullHead ();
+    }
 
     m_text.insert (m_cursor++, ch);
 
     updatePinyin ();
+    streamCommit ();
     update ();
     return TRUE;
 }
@@ -70,6 +81,7 @@ FullPinyinEditor::processKeyEvent (guint keyval,
 void
 FullPinyinEditor::updatePinyin (void)
 {
+    PY_TRACE ("FullPinyinEditor::updatePinyin", "libpinyin");
     if (G_UNLIKELY (m_text.empty ())) {
         m_pinyin_len = 0;
         /* TODO: check whether to replace "" with NULL. */
@@ -83,9 +95,156 @@ FullPinyinEditor::updatePinyin (void)
     pinyin_guess_sentence (m_instance);
 }
 
+/* Commit the head of a long input that the last STREAMING_STABLE_KEYS
+ * guesses agreed on, and keep parsing only the rest of it. */
+void
+FullPinyinEditor::streamCommit (void)
+{
+    guint threshold = m_config.streamingCommitLength ();
+    if (threshold == 0)
+        return;
+
+    /* only follow plain typing at the end of a fully parsed input. */
+    gboolean appended = m_recent_text.length () + 1 == m_text.length () &&
+        m_text.compare (0, m_recent_text.length (), m_recent_text) == 0;
+    m_recent_text = m_text;
+    if (!appended)
+        m_recent_sentences.clear ();
+    if (m_cursor != m_text.length () || m_pinyin_len != m_text.length ()) {
+        m_recent_sentences.clear ();
+        return;
+    }
+
+    char *sentence = NULL;
+    pinyin_get_sentence (m_instance, 0, &sentence);
+    if (sentence == NULL)
+        return;
+    m_recent_sentences.push_back (sentence);
+    g_free (sentence);
+
+    if (m_recent_sentences.size () > STREAMING_STABLE_KEYS)
+        m_recent_sentences.pop_front ();
+    if (m_recent_sentences.size () < STREAMING_STABLE_KEYS ||
+        m_text.length () < threshold)
+        return;
+
+    const std::string & last = m_recent_sentences.back ();
+    commitHead (last, stableHeadLength ());
+}
+
+/* the longest head shared by the recent guesses, in bytes. */
+size_t
+FullPinyinEditor::stableHeadLength (void)
+{
+    const std::string & last = m_recent_sentences.back ();
+    size_t common = last.length ();
+    for (auto & recent : m_recent_sentences) {
+        size_t i = 0;
+        while (i < common && i < recent.length () && recent[i] == last[i])
+            i++;
+        common = i;
+    }
+    return common;
+}
+
+/* Commit the characters of sentence within its first common bytes,
+ * always leaving the last character to the parse, when their pinyin
+ * ends at a key boundary, and keep parsing only the rest of the input. */
+gboolean
+FullPinyinEditor::commitHead (std::string sentence, size_t common)
+{
+    const gchar *head_end = sentence.c_str ();
+    guint n_chars = 0;
+    while (*head_end) {
+        const gchar *next = g_utf8_next_char (head_end);
+        if ((size_t)(next - sentence.c_str ()) > common || *next == '\0')
+            break;
+        head_end = next;
+        n_chars++;
+    }
+    if (n_chars == 0)
+        return FALSE;
+
+    /* find where the pinyin of the head ends, at a key boundary. */
+    size_t offset;
+    for (offset = 1; offset < m_pinyin_len; offset++) {
+        size_t length = 0;
+        pinyin_get_character_offset
+            (m_instance, sentence.c_str (), offset, &length);
+        if (length < n_chars)
+            continue;
+        if (length > n_chars)
+            return FALSE;
+
+        PinyinKeyPos *pos = NULL;
+        guint16 begin = 0;
+        if (pinyin_get_pinyin_key_rest (m_instance, offset, &pos) &&
+            pinyin_get_pinyin_key_rest_positions (m_instance, pos, &begin, NULL) &&
+            begin == offset)
+            break;
+    }
+    if (offset >= m_pinyin_len || offset > m_cursor)
+        return FALSE;
+
+    std::string head (sentence.c_str (), head_end - sentence.c_str ());
+
+    m_buffer.clear ();
+    if (m_props.modeSimp ())
+        m_buffer << head;
+    else
+        SimpTradConverter::simpToTrad (head.c_str (), m_buffer);
+    PhoneticEditor::commit ((const gchar *)m_buffer);
+
+    /* learn from the head only when it still reads the same alone. */
+    String pinyin (m_text.substr (0, offset));
+    pinyin_parse_more_full_pinyins (m_instance, pinyin.c_str ());
+    pinyin_guess_sentence (m_instance);
+    char *guess = NULL;
+    pinyin_get_sentence (m_instance, 0, &guess);
+    if (guess && head == guess)
+        m_instance = LibPinyinBackEnd::instance ().trainPinyinInstance
+            (m_instance, 0, m_config.rememberEveryInput ());
+    g_free (guess);
+
+    /* re-anchor the rest in a fresh parse. */
+    m_text.erase (0, offset);
+    m_cursor -= offset;
+    m_recent_sentences.clear ();
+    m_recent_text = m_text;
+    updatePinyin ();
+    return TRUE;
+}
+
+/* At MAX_PINYIN_LEN, commit the stable head of the recent guesses,
+ * or the longest head of the current guess, or else the whole input,
+ * so the next key is never dropped. */
+void
+FullPinyinEditor::commitFullHead (void)
+{
+    char *sentence = NULL;
+    if (m_pinyin_len > 0)
+        pinyin_get_sentence (m_instance, 0, &sentence);
+
+    if (sentence) {
+        std::string last = sentence;
+        g_free (sentence);
+
+        gboolean stable = m_recent_sentences.size () == STREAMING_STABLE_KEYS &&
+            m_recent_sentences.back () == last;
+        if (stable && commitHead (last, stableHeadLength ()))
+            return;
+        if (commitHead (last, last.length ()))
+            return;
+    }
+
+    /* no head ends at a key boundary, or nothing is parsed. */
+    commit ();
+}
+
 void
 FullPinyinEditor::updateAuxiliaryText (void)
 {
+    PY_TRACE ("FullPinyinEditor::updateAuxiliaryText", "editor");
     if (G_UNLIKELY (m_text.empty ())) {
         hideAuxiliaryText ();
         return;
@@ -109,8 +268,12 @@ FullPinyinEditor::updateAuxiliaryText (void)
 void
 FullPinyinEditor::update (void)
 {
+    PY_TRACE ("FullPinyinEditor::update", "editor");
     guint lookup_cursor = getLookupCursor ();
-    pinyin_guess_candidates (m_instance, lookup_cursor);
+    {
+        PY_TRACE ("pinyin_guess_candidates", "libpinyin");
+        pinyin_guess_candidates (m_instance, lookup_cursor);
+    }
 
     updateLookupTable ();
     updatePreeditText ();
@@ -134,3 +297,17 @@ FullPinyinEditor::getLookupCursor (void)
         lookup_cursor = 0;
     return lookup_cursor;
 }
+
+/* the table is keyed on full pinyin, so only the raw input of
+ * this editor can be looked up. */
+void
+FullPinyinEditor::lookupSpecialPhrases (void)
+{
+    SpecialPhraseTable *table = SpecialPhraseTable::instance ();
+    if (table == NULL || !m_config.specialPhrases () ||
+        m_text.empty () || m_cursor != m_text.length ())
+        return;
+
+    PY_TRACE ("SpecialPhraseTable::lookup", "phrases");
+    table->lookup (m_text.c_str (), m_special_phrases);
+}
@@ -21,6 +21,8 @@
 #ifndef __PY_LIB_PINYIN_FULL_PINYIN_EDITOR_H
 #define __PY_LIB_PINYIN_FULL_PINYIN_EDITOR_H
 
+#include <deque>
+#include <string>
 #include "PYPPinyinEditor.h"
 
 namespace PY {
@@ -46,6 +48,16 @@ protected:
 
     virtual guint getLookupCursor (void);
 
+    virtual void lookupSpecialPhrases (void);
+
+    void streamCommit (void);
+    size_t stableHeadLength (void);
+    gboolean commitHead (std::string sentence, size_t common);
+    void commitFullHead (void);
+
+    /* guessed sentences of the last few keystrokes, for streaming. */
+    std::deque<std::string>     m_recent_sentences;
+    String                      m_recent_text;
 };
 
 };
@@ -22,6 +22,13 @@
 #include "PYConfig.h"
 #include "PYPinyinProperties.h"
 #include "PYSimpTradConverter.h"
+#include "PYTrace.h"
+#ifdef IBUS_BUILD_LUA_EXTENSION
+extern "C" {
+#include "lua-plugin.h"
+}
+#include "PYExtEditor.h"
+#endif
 
 using namespace PY;
 
@@ -30,11 +37,19 @@ PhoneticEditor::PhoneticEditor (PinyinProperties &props,
                                                   Config &config):
     Editor (props, config),
     m_pinyin_len (0),
-    m_lookup_table (m_config.pageSize ())
+    m_lookup_table (m_config.pageSize ()),
+    m_buffer (128)
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    , m_trigger_cancellable (NULL),
+    m_trigger_kind (LUA_TRIGGER_INPUT)
+#endif
 {
 }
 
 PhoneticEditor::~PhoneticEditor (){
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    cancelTrigger ();
+#endif
 }
 
 gboolean
@@ -159,6 +174,10 @@ PhoneticEditor::processFunctionKey (guint keyval, guint keycode, guint modifiers
         case IBUS_D:
             {
                 guint index = m_lookup_table.cursorPos ();
+                if (index < m_special_phrases.size ())
+                    return TRUE;
+                index -= m_special_phrases.size ();
+
                 lookup_candidate_t * candidate = NULL;
                 pinyin_get_candidate (m_instance, index, &candidate);
                 if (pinyin_is_user_candidate (m_instance, candidate)) {
@@ -190,6 +209,7 @@ PhoneticEditor::updateLookupTableFast (void)
 void
 PhoneticEditor::updateLookupTable (void)
 {
+    PY_TRACE ("PhoneticEditor::updateLookupTable", "editor");
     m_lookup_table.clear ();
 
     fillLookupTable ();
@@ -246,10 +266,27 @@ PhoneticEditor::fillLookupTableByPage (void)
 gboolean
 PhoneticEditor::fillLookupTable (void)
 {
+    m_special_phrases.clear ();
+    lookupSpecialPhrases ();
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    /* the input triggers are called once for each input. */
+    if (!m_text.empty () && m_cursor == m_text.length () &&
+        (m_trigger_kind != LUA_TRIGGER_INPUT || m_trigger_text != m_text))
+        callTrigger (LUA_TRIGGER_INPUT, m_text);
+    if ((m_trigger_kind == LUA_TRIGGER_INPUT && m_trigger_text == m_text &&
+         m_cursor == m_text.length ()) ||
+        (m_trigger_kind == LUA_TRIGGER_CANDIDATE && m_text.empty ()))
+        m_special_phrases.insert (m_special_phrases.end (),
+                                  m_trigger_phrases.begin (),
+                                  m_trigger_phrases.end ());
+#endif
+    for (guint i = 0; i < m_special_phrases.size (); i++)
+        m_lookup_table.appendCandidate (Text (m_special_phrases[i]));
+
     guint len = 0;
     pinyin_get_n_candidate (m_instance, &len);
 
-    String word;
+    String word (64);
     for (guint i = 0; i < len; i++) {
         lookup_candidate_t * candidate = NULL;
         pinyin_get_candidate (m_instance, i, &candidate);
@@ -326,6 +363,12 @@ PhoneticEditor::reset (void)
 {
     m_pinyin_len = 0;
     m_lookup_table.clear ();
+    m_special_phrases.clear ();
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    cancelTrigger ();
+    m_trigger_text.clear ();
+    m_trigger_phrases.clear ();
+#endif
 
     pinyin_reset (m_instance);
 
@@ -335,8 +378,12 @@ PhoneticEditor::reset (void)
 void
 PhoneticEditor::update (void)
 {
+    PY_TRACE ("PhoneticEditor::update", "editor");
     guint lookup_cursor = getLookupCursor ();
-    pinyin_guess_candidates (m_instance, lookup_cursor);
+    {
+        PY_TRACE ("pinyin_guess_candidates", "libpinyin");
+        pinyin_guess_candidates (m_instance, lookup_cursor);
+    }
 
     updateLookupTable ();
     updatePreeditText ();
@@ -350,6 +397,124 @@ PhoneticEditor::commit (const gchar *str)
     commitText (text);
 }
 
+#ifdef IBUS_BUILD_LUA_EXTENSION
+void
+PhoneticEditor::callTrigger (gint kind, const std::string & text)
+{
+    cancelTrigger ();
+    m_trigger_kind = kind;
+    m_trigger_text = text;
+    m_trigger_phrases.clear ();
+
+    /* NULL until the scripts are loaded, the triggers are skipped. */
+    IBusEnginePlugin *plugin = ExtEditor::triggerPlugin ();
+    if (plugin == NULL)
+        return;
+
+    /* one pass over the text in C, lua only runs on a match. */
+    const lua_command_t * trigger = NULL;
+    if (!ibus_engine_plugin_match_triggers (plugin,
+                                            (lua_trigger_kind_t) kind,
+                                            text.c_str (), &trigger, 1))
+        return;
+
+    PY_TRACE ("PhoneticEditor::callTrigger", "lua");
+    m_trigger_cancellable = g_cancellable_new ();
+    ibus_engine_plugin_call_command_async (plugin, trigger, text.c_str (),
+                                           m_trigger_cancellable,
+                                           triggerReadyCallback, this);
+}
+
+void
+PhoneticEditor::cancelTrigger (void)
+{
+    if (m_trigger_cancellable == NULL)
+        return;
+
+    g_cancellable_cancel (m_trigger_cancellable);
+    g_object_unref (m_trigger_cancellable);
+    m_trigger_cancellable = NULL;
+}
+
+void
+PhoneticEditor::triggerReadyCallback (GObject * source,
+                                      GAsyncResult * result,
+                                      gpointer user_data)
+{
+    /* a cancelled call may outlive its editor, drop its results. */
+    if (g_cancellable_is_cancelled (g_task_get_cancellable (G_TASK (result))))
+        return;
+
+    PhoneticEditor *self = static_cast<PhoneticEditor *> (user_data);
+    lua_command_candidates_t * candidates = NULL;
+    int result_num = ibus_engine_plugin_call_command_finish
+        (IBUS_ENGINE_PLUGIN (source), result, &candidates);
+    self->triggerReady (result_num, candidates);
+}
+
+void
+PhoneticEditor::triggerReady (int result_num, lua_command_candidates_t * candidates)
+{
+    g_object_unref (m_trigger_cancellable);
+    m_trigger_cancellable = NULL;
+
+    if (candidates == NULL)
+        return;
+
+    /* only the results with a content can be committed. */
+    for (guint i = 0; result_num > 0 && i < candidates->len; i++) {
+        if (candidates->candidates[i].content)
+            m_trigger_phrases.push_back (candidates->candidates[i].content);
+    }
+    ibus_engine_plugin_candidates_unref (candidates);
+
+    if (!m_trigger_phrases.empty ())
+        updateLookupTable ();
+}
+
+gboolean
+PhoneticEditor::processTriggerKey (guint keyval, guint keycode, guint modifiers)
+{
+    if (!m_text.empty () || m_trigger_kind != LUA_TRIGGER_CANDIDATE ||
+        m_trigger_phrases.empty ())
+        return FALSE;
+
+    if (cmshm_filter (modifiers) == 0) {
+        switch (keyval) {
+        case IBUS_1 ... IBUS_9:
+            selectCandidateInPage (keyval - IBUS_1);
+            update ();
+            return TRUE;
+        case IBUS_space:
+            selectCandidate (m_lookup_table.cursorPos ());
+            update ();
+            return TRUE;
+        case IBUS_Up:
+            cursorUp ();
+            return TRUE;
+        case IBUS_Down:
+            cursorDown ();
+            return TRUE;
+        case IBUS_Page_Up:
+            pageUp ();
+            return TRUE;
+        case IBUS_Page_Down:
+            pageDown ();
+            return TRUE;
+        case IBUS_Escape:
+            reset ();
+            update ();
+            return TRUE;
+        }
+    }
+
+    /* other keys dismiss the results, and are processed as usual. */
+    reset ();
+    update ();
+    return FALSE;
+}
+#endif
+
 guint
 PhoneticEditor::getPinyinCursor ()
 {
@@ -374,6 +539,13 @@ PhoneticEditor::getLookupCursor (void)
 gboolean
 PhoneticEditor::selectCandidate (guint i)
 {
+    if (i < m_special_phrases.size ()) {
+        commit (m_special_phrases[i].c_str ());
+        reset ();
+        return TRUE;
+    }
+    i -= m_special_phrases.size ();
+
     guint len = 0;
     pinyin_get_n_candidate (m_instance, &len);
 
@@ -22,8 +22,14 @@
 #define __PY_LIB_PINYIN_BASE_EDITOR_H_
 
 #include <pinyin.h>
+#include <string>
+#include <vector>
 #include "PYLookupTable.h"
 #include "PYEditor.h"
+#ifdef IBUS_BUILD_LUA_EXTENSION
+typedef struct _IBusEnginePlugin IBusEnginePlugin;
+typedef struct _lua_command_candidates_t lua_command_candidates_t;
+#endif
 
 
 namespace PY {
@@ -76,14 +82,40 @@ protected:
     virtual void updatePreeditText (void) = 0;
     virtual void updatePinyin (void) = 0;
 
+    /* append the special phrases of the input to m_special_phrases. */
+    virtual void lookupSpecialPhrases (void) { }
+
     guint getCursorLeftByWord (void);
     guint getCursorRightByWord (void);
 
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    /* lua triggers run on the worker thread of the plugin,
+     * their results are shown with the special phrases. */
+    void callTrigger (gint kind, const std::string & text);
+    void cancelTrigger (void);
+    void triggerReady (int result_num, lua_command_candidates_t * candidates);
+    static void triggerReadyCallback (GObject * source,
+                                      GAsyncResult * result,
+                                      gpointer user_data);
+    /* select the results of the candidate triggers after a commit. */
+    gboolean processTriggerKey (guint keyval, guint keycode, guint modifiers);
+#endif
+
 
     /* varibles */
     guint                       m_pinyin_len;
     LookupTable                 m_lookup_table;
     String                      m_buffer;
+    /* shown before the libpinyin candidates. */
+    std::vector<std::string>    m_special_phrases;
+
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    GCancellable                *m_trigger_cancellable;
+    gint                        m_trigger_kind;
+    /* the input or the commit the trigger results belong to. */
+    std::string                 m_trigger_text;
+    std::vector<std::string>    m_trigger_phrases;
+#endif
 
     /* use LibPinyinBackEnd here. */
     pinyin_instance_t           *m_instance;
@@ -25,6 +25,12 @@
 #include "PYSimpTradConverter.h"
 #include "PYHalfFullConverter.h"
 #include "PYLibPinyin.h"
+#include "PYTrace.h"
+#ifdef IBUS_BUILD_LUA_EXTENSION
+extern "C" {
+#include "lua-plugin.h"
+}
+#endif
 
 using namespace PY;
 
@@ -179,6 +185,11 @@ PinyinEditor::processKeyEvent (guint keyval, guint keycode,
                   IBUS_META_MASK |
                   IBUS_LOCK_MASK);
 
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    if (G_UNLIKELY (processTriggerKey (keyval, keycode, modifiers)))
+        return TRUE;
+#endif
+
     switch (keyval) {
     /* letters */
     case IBUS_a ... IBUS_z:
@@ -221,24 +232,29 @@ PinyinEditor::commit (gint index)
     /* text after pinyin */
     const gchar *p = m_text.c_str() + m_pinyin_len;
     if (G_UNLIKELY (m_props.modeFull ())) {
-        while (*p != '\0') {
-            m_buffer.appendUnichar (HalfFullConverter::toFull (*p++));
-        }
+        HalfFullConverter::toFull (p, m_buffer);
     } else {
         m_buffer << p;
     }
 
-    pinyin_train (m_instance, index);
-    if (m_config.rememberEveryInput ())
-        LibPinyinBackEnd::instance ().rememberUserInput (m_instance, index);
-    LibPinyinBackEnd::instance ().modified ();
     PhoneticEditor::commit ((const gchar *)m_buffer);
+    /* learn from the committed instance after the text is delivered. */
+    m_instance = LibPinyinBackEnd::instance ().trainPinyinInstance
+        (m_instance, index, m_config.rememberEveryInput ());
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    std::string committed = m_buffer;
+#endif
     reset();
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    /* offer the results of the candidate triggers matching the commit. */
+    callTrigger (LUA_TRIGGER_CANDIDATE, committed);
+#endif
 }
 
 void
 PinyinEditor::updatePreeditText ()
 {
+    PY_TRACE ("PinyinEditor::updatePreeditText", "editor");
     /* preedit text = guessed sentence + un-parsed pinyin text */
     if (G_UNLIKELY (m_text.empty ())) {
         hidePreeditText ();
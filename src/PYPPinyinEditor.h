@@ -26,6 +26,8 @@
 namespace PY {
 
 #define MAX_PINYIN_LEN 64
+/* keystrokes a sentence head must survive before it is streamed out. */
+#define STREAMING_STABLE_KEYS 4
 
 class Config;
 
@@ -23,6 +23,7 @@
 #include <string>
 #include "PYConfig.h"
 #include "PYPConfig.h"
+#include "PYDiagnostics.h"
 #include "PYPunctEditor.h"
 #include "PYRawEditor.h"
 #ifdef IBUS_BUILD_LUA_EXTENSION
@@ -46,7 +47,10 @@ PinyinEngine::PinyinEngine (IBusEngine *engine)
       m_props (PinyinConfig::instance ()),
       m_prev_pressed_key (IBUS_VoidSymbol),
       m_input_mode (MODE_INIT),
-      m_fallback_editor (new FallbackEditor (m_props, PinyinConfig::instance ()))
+      m_fallback_editor (new FallbackEditor (m_props, PinyinConfig::instance ())),
+      m_content_type_policy (CONTENT_TYPE_POLICY_NORMAL),
+      m_forced_english (FALSE),
+      m_idle_timeout_id (0)
 {
     gint i;
 
@@ -64,35 +68,116 @@ PinyinEngine::PinyinEngine (IBusEngine *engine)
     m_editors[MODE_RAW].reset
         (new RawEditor (m_props, PinyinConfig::instance ()));
 
-#ifdef IBUS_BUILD_LUA_EXTENSION
-    m_editors[MODE_EXTENSION].reset (new ExtEditor (m_props, PinyinConfig::instance ()));
-#else
-    m_editors[MODE_EXTENSION].reset (new Editor (m_props, PinyinConfig::instance ()));
-#endif
-#ifdef IBUS_BUILD_ENGLISH_INPUT_MODE
-    m_editors[MODE_ENGLISH].reset (new EnglishEditor (m_props, PinyinConfig::instance ()));
-#else
-    m_editors[MODE_ENGLISH].reset (new Editor (m_props, PinyinConfig::instance ()));
-#endif
-#ifdef IBUS_BUILD_STROKE_INPUT_MODE
-    m_editors[MODE_STROKE].reset (new StrokeEditor (m_props, PinyinConfig::instance ()));
-#else
-    m_editors[MODE_STROKE].reset (new Editor (m_props, PinyinConfig::instance ()));
-#endif
+    /* MODE_ENGLISH, MODE_STROKE and MODE_EXTENSION are created
+     * by createEditor when the mode is entered for the first time. */
 
     m_props.signalUpdateProperty ().connect
         (std::bind (&PinyinEngine::updateProperty, this, _1));
 
     for (i = MODE_INIT; i < MODE_LAST; i++) {
-        connectEditorSignals (m_editors[i]);
+        m_editor_last_used[i] = 0;
+        if (m_editors[i])
+            connectEditorSignals (m_editors[i]);
     }
 
     connectEditorSignals (m_fallback_editor);
+
+    m_diagnostics_id = Diagnostics::addReporter
+        (std::bind (&PinyinEngine::reportDiagnostics, this, _1));
 }
 
 /* destructor */
 PinyinEngine::~PinyinEngine (void)
 {
+    Diagnostics::removeReporter (m_diagnostics_id);
+    stopIdleTimer ();
+}
+
+void
+PinyinEngine::createEditor (gint mode)
+{
+    switch (mode) {
+#ifdef IBUS_BUILD_LUA_EXTENSION
+    case MODE_EXTENSION:
+        m_editors[mode].reset (new ExtEditor (m_props, PinyinConfig::instance ()));
+        break;
+#endif
+#ifdef IBUS_BUILD_ENGLISH_INPUT_MODE
+    case MODE_ENGLISH:
+        m_editors[mode].reset (new EnglishEditor (m_props, PinyinConfig::instance ()));
+        break;
+#endif
+#ifdef IBUS_BUILD_STROKE_INPUT_MODE
+    case MODE_STROKE:
+        m_editors[mode].reset (new StrokeEditor (m_props, PinyinConfig::instance ()));
+        break;
+#endif
+    default:
+        m_editors[mode].reset (new Editor (m_props, PinyinConfig::instance ()));
+        break;
+    }
+
+    connectEditorSignals (m_editors[mode]);
+    startIdleTimer ();
+}
+
+void
+PinyinEngine::startIdleTimer (void)
+{
+    guint timeout = PinyinConfig::instance ().editorIdleTimeout ();
+
+    /* zero means keep the editors until the engine is destroyed. */
+    if (m_idle_timeout_id != 0 || timeout == 0)
+        return;
+
+    m_idle_timeout_id = g_timeout_add_seconds (timeout,
+                                               PinyinEngine::idleTimeoutCallback,
+                                               static_cast<gpointer> (this));
+}
+
+void
+PinyinEngine::stopIdleTimer (void)
+{
+    if (m_idle_timeout_id != 0) {
+        g_source_remove (m_idle_timeout_id);
+        m_idle_timeout_id = 0;
+    }
+}
+
+gboolean
+PinyinEngine::idleTimeoutCallback (gpointer user_data)
+{
+    PinyinEngine *self = static_cast<PinyinEngine *> (user_data);
+    guint timeout = PinyinConfig::instance ().editorIdleTimeout ();
+    gint64 now = g_get_monotonic_time ();
+    gboolean pending = FALSE;
+
+    if (timeout == 0) {
+        self->m_idle_timeout_id = 0;
+        return FALSE;
+    }
+
+    const gint lazy_modes[] = { MODE_ENGLISH, MODE_STROKE, MODE_EXTENSION };
+    for (guint i = 0; i < G_N_ELEMENTS (lazy_modes); i++) {
+        gint mode = lazy_modes[i];
+        if (!self->m_editors[mode])
+            continue;
+
+        /* never release the editor in use. */
+        if (mode == self->m_input_mode ||
+            now - self->m_editor_last_used[mode] < (gint64) timeout * G_USEC_PER_SEC) {
+            pending = TRUE;
+            continue;
+        }
+
+        self->m_editors[mode].reset ();
+    }
+
+    if (pending)
+        return TRUE;
+
+    self->m_idle_timeout_id = 0;
+    return FALSE;
 }
 
 /* keep synced with bopomofo engine. */
@@ -100,11 +185,13 @@ gboolean
 PinyinEngine::processAccelKeyEvent (guint keyval, guint keycode,
                                     guint modifiers)
 {
-    std::string accel;
-    pinyin_accelerator_name (keyval, modifiers, accel);
+    const PinyinConfig & config = PinyinConfig::instance ();
+    guint accel_keyval = keyval;
+    guint accel_modifiers = modifiers;
+    pinyin_accelerator_normalize (accel_keyval, accel_modifiers);
 
     /* Safe Guard for empty key. */
-    if ("" == accel)
+    if (0 == accel_keyval && 0 == accel_modifiers)
         return FALSE;
 
     /* check Shift or Ctrl + Release hotkey,
@@ -115,7 +202,7 @@ PinyinEngine::processAccelKeyEvent (guint keyval, guint keycode,
         gboolean triggered = FALSE;
 
         if (m_prev_pressed_key == keyval) {
-            if (PinyinConfig::instance ().mainSwitch () == accel) {
+            if (config.mainSwitchAccel ().match (accel_keyval, accel_modifiers)) {
                 triggered = TRUE;
             }
         }
@@ -138,21 +225,21 @@ PinyinEngine::processAccelKeyEvent (guint keyval, guint keycode,
     }
 
     /* Toggle full/half Letter Mode */
-    if (PinyinConfig::instance (). letterSwitch () == accel) {
+    if (config.letterSwitchAccel ().match (accel_keyval, accel_modifiers)) {
         m_props.toggleModeFull ();
         m_prev_pressed_key = keyval;
         return TRUE;
     }
 
     /* Toggle full/half Punct Mode */
-    if (PinyinConfig::instance (). punctSwitch () == accel) {
+    if (config.punctSwitchAccel ().match (accel_keyval, accel_modifiers)) {
         m_props.toggleModeFullPunct ();
         m_prev_pressed_key = keyval;
         return TRUE;
     }
 
     /* Toggle simp/trad Chinese Mode */
-    if (PinyinConfig::instance ().tradSwitch () == accel) {
+    if (config.tradSwitchAccel ().match (accel_keyval, accel_modifiers)) {
         m_props.toggleModeSimp ();
         m_prev_pressed_key = keyval;
         return TRUE;
@@ -169,6 +256,9 @@ PinyinEngine::processKeyEvent (guint keyval, guint keycode, guint modifiers)
     if (contentIsPassword ())
         return retval;
 
+    if (m_content_type_policy == CONTENT_TYPE_POLICY_PASSTHROUGH)
+        return retval;
+
     if (processAccelKeyEvent (keyval, keycode, modifiers))
         return TRUE;
 
@@ -176,7 +266,8 @@ PinyinEngine::processKeyEvent (guint keyval, guint keycode, guint modifiers)
     if (modifiers & IBUS_RELEASE_MASK)
         return FALSE;
 
-    if (m_props.modeChinese ()) {
+    if (m_props.modeChinese () &&
+        m_content_type_policy != CONTENT_TYPE_POLICY_FALLBACK) {
         if (m_input_mode == MODE_INIT &&
             (cmshm_filter (modifiers) == 0)) {
             const String & text = m_editors[MODE_INIT]->text ();
@@ -216,10 +307,18 @@ PinyinEngine::processKeyEvent (guint keyval, guint keycode, guint modifiers)
                     break;
 #endif
                 }
+#ifdef IBUS_BUILD_LUA_EXTENSION
+                /* drop the results of the last commit triggers. */
+                if (m_input_mode != MODE_INIT)
+                    m_editors[MODE_INIT]->reset ();
+#endif
             } else {
                 /* TODO: Unknown */
             }
         }
+        if (G_UNLIKELY (!m_editors[m_input_mode]))
+            createEditor (m_input_mode);
+        m_editor_last_used[m_input_mode] = g_get_monotonic_time ();
         retval = m_editors[m_input_mode]->processKeyEvent (keyval, keycode, modifiers);
         if (G_UNLIKELY (retval &&
                         m_input_mode != MODE_INIT &&
@@ -263,17 +362,54 @@ void
 PinyinEngine::focusOut (void)
 {
     Engine::focusOut ();
+    applyContentTypePolicy (CONTENT_TYPE_POLICY_NORMAL);
 
     reset ();
 }
 
+#if IBUS_CHECK_VERSION (1, 5, 4)
+void
+PinyinEngine::setContentType (guint purpose, guint hints)
+{
+    Engine::setContentType (purpose, hints);
+    applyContentTypePolicy (PinyinConfig::instance ().contentTypePolicy (purpose));
+}
+#endif
+
+void
+PinyinEngine::applyContentTypePolicy (ContentTypePolicy policy)
+{
+    m_content_type_policy = policy;
+
+    if (policy == CONTENT_TYPE_POLICY_ENGLISH) {
+        if (m_props.modeChinese ()) {
+            reset ();
+            m_props.toggleModeChinese ();
+            m_forced_english = TRUE;
+        }
+    }
+    else if (m_forced_english) {
+        /* restore chinese mode, unless the user already did. */
+        if (!m_props.modeChinese ())
+            m_props.toggleModeChinese ();
+        m_forced_english = FALSE;
+    }
+}
+
 void
 PinyinEngine::reset (void)
 {
+    gint active_mode = m_input_mode;
+
     m_prev_pressed_key = IBUS_VoidSymbol;
     m_input_mode = MODE_INIT;
+    /* only the active editor and editors holding input need a reset,
+     * resetting the others just sends redundant hide signals. */
     for (gint i = 0; i < MODE_LAST; i++) {
-        m_editors[i]->reset ();
+        if (!m_editors[i])
+            continue;
+        if (i == active_mode || m_editors[i]->dirty ())
+            m_editors[i]->reset ();
     }
     m_fallback_editor->reset ();
 }
@@ -287,6 +423,9 @@ PinyinEngine::enable (void)
 void
 PinyinEngine::disable (void)
 {
+    /* ibus hides the preedit, auxiliary text and lookup table
+     * of a disabled engine by itself. */
+    invalidateFrame ();
 }
 
 void
@@ -340,6 +479,24 @@ PinyinEngine::candidateClicked (guint index, guint button, guint state)
     m_editors[m_input_mode]->candidateClicked (index, button, state);
 }
 
+void
+PinyinEngine::reportDiagnostics (String & output)
+{
+    static const gchar * const names[MODE_LAST] = { "init", "punct", "raw", "english", "stroke", "extension" };
+    gsize total = m_fallback_editor->memoryUsage ();
+
+    output.appendPrintf ("pinyin engine %p:\n", this);
+    for (gint i = MODE_INIT; i < MODE_LAST; i++) {
+        if (!m_editors[i])
+            continue;
+        gsize size = m_editors[i]->memoryUsage ();
+        output.appendPrintf ("  %s editor: %" G_GSIZE_FORMAT " bytes\n",
+                             names[i], size);
+        total += size;
+    }
+    output.appendPrintf ("  total: %" G_GSIZE_FORMAT " bytes\n", total);
+}
+
 void
 PinyinEngine::commitText (Text & text)
 {
@@ -23,6 +23,7 @@
 #define __PY_LIB_PINYIN_PINYIN_ENGINE_H_
 
 #include "PYEngine.h"
+#include "PYConfig.h"
 #include "PYPinyinProperties.h"
 
 namespace PY {
@@ -37,6 +38,9 @@ public:
     gboolean processKeyEvent (guint keyval, guint keycode, guint modifiers);
     void focusIn (void);
     void focusOut (void);
+#if IBUS_CHECK_VERSION (1, 5, 4)
+    void setContentType (guint purpose, guint hints);
+#endif
     void reset (void);
     void enable (void);
     void disable (void);
@@ -52,8 +56,14 @@ private:
 
     void showSetupDialog (void);
     void connectEditorSignals (EditorPtr editor);
+    void applyContentTypePolicy (ContentTypePolicy policy);
+    void createEditor (gint mode);
+    void startIdleTimer (void);
+    void stopIdleTimer (void);
+    static gboolean idleTimeoutCallback (gpointer user_data);
 
     void commitText (Text & text);
+    void reportDiagnostics (String & output);
 
 private:
     PinyinProperties m_props;
@@ -72,9 +82,17 @@ private:
 
     gboolean m_double_pinyin;
 
+    /* english, stroke and extension editors are created on demand,
+     * and released again after staying unused for a while. */
     EditorPtr m_editors[MODE_LAST];
     EditorPtr m_fallback_editor;
 
+    ContentTypePolicy m_content_type_policy;
+    gboolean m_forced_english;      // english mode set by the policy
+
+    gint64 m_editor_last_used[MODE_LAST];
+    guint m_idle_timeout_id;
+    guint m_diagnostics_id;
 };
 
 };
@@ -19,9 +19,9 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
-#include <algorithm>
 #include "PYConfig.h"
 #include "PYPunctEditor.h"
+#include "PYTrace.h"
 
 namespace PY {
 
@@ -30,7 +30,10 @@ namespace PY {
 PunctEditor::PunctEditor (PinyinProperties & props, Config & config)
     : Editor (props, config),
       m_punct_mode (MODE_DISABLE),
-      m_lookup_table (m_config.pageSize ())
+      m_lookup_table (m_config.pageSize ()),
+      m_buffer (64),
+      m_punct_candidates (NULL),
+      m_punct_key (G_MAXUINT)
 {
 }
 
@@ -46,7 +49,7 @@ PunctEditor::insert (gchar ch)
             m_punct_mode = MODE_INIT;
             updatePunctCandidates (0);
             m_selected_puncts.clear ();
-            m_selected_puncts.insert (m_selected_puncts.begin (), m_punct_candidates[0]);
+            m_selected_puncts.insert (m_selected_puncts.begin (), 0);
             update ();
         }
         break;
@@ -61,8 +64,8 @@ PunctEditor::insert (gchar ch)
             m_text.insert (m_cursor, ch);
             updatePunctCandidates (ch);
             m_punct_mode = MODE_NORMAL;
-            if (m_punct_candidates.size () > 0) {
-                m_selected_puncts.insert (m_selected_puncts.begin () + m_cursor, m_punct_candidates[0]);
+            if (m_punct_candidates != NULL) {
+                m_selected_puncts.insert (m_selected_puncts.begin () + m_cursor, 0);
             }
             m_cursor ++;
             update ();
@@ -225,7 +228,7 @@ void
 PunctEditor::pageUp (void)
 {
     if (G_LIKELY (m_lookup_table.pageUp ())) {
-        m_selected_puncts[m_cursor - 1] = m_punct_candidates[m_lookup_table.cursorPos ()];
+        m_selected_puncts[m_cursor - 1] = m_lookup_table.cursorPos ();
         updateLookupTableFast (m_lookup_table, TRUE);
         updatePreeditText ();
         updateAuxiliaryText ();
@@ -236,7 +239,7 @@ void
 PunctEditor::pageDown (void)
 {
     if (G_LIKELY (m_lookup_table.pageDown ())) {
-        m_selected_puncts[m_cursor - 1] = m_punct_candidates[m_lookup_table.cursorPos ()];
+        m_selected_puncts[m_cursor - 1] = m_lookup_table.cursorPos ();
         updateLookupTableFast (m_lookup_table, TRUE);
         updatePreeditText ();
         updateAuxiliaryText ();
@@ -247,7 +250,7 @@ void
 PunctEditor::cursorUp (void)
 {
     if (G_LIKELY (m_lookup_table.cursorUp ())) {
-        m_selected_puncts[m_cursor - 1] = m_punct_candidates[m_lookup_table.cursorPos ()];
+        m_selected_puncts[m_cursor - 1] = m_lookup_table.cursorPos ();
         updateLookupTableFast (m_lookup_table, TRUE);
         updatePreeditText ();
         updateAuxiliaryText ();
@@ -258,7 +261,7 @@ void
 PunctEditor::cursorDown (void)
 {
     if (G_LIKELY (m_lookup_table.cursorDown ())) {
-        m_selected_puncts[m_cursor - 1] = m_punct_candidates[m_lookup_table.cursorPos ()];
+        m_selected_puncts[m_cursor - 1] = m_lookup_table.cursorPos ();
         updateLookupTableFast (m_lookup_table, TRUE);
         updatePreeditText ();
         updateAuxiliaryText ();
@@ -272,18 +275,10 @@ PunctEditor::moveCursorLeft (void)
         return FALSE;
     m_cursor --;
     if (m_cursor == 0)  {
-        m_punct_candidates.clear ();
-        fillLookupTable ();
+        clearPunctCandidates ();
     }
     else {
-        updatePunctCandidates (m_text[m_cursor - 1]);
-        /* restore cursor pos */
-        std::vector<const gchar *>::iterator it;
-        it = std::find (m_punct_candidates.begin (),
-                        m_punct_candidates.end (),
-                        m_selected_puncts[m_cursor - 1]);
-        g_assert (it != m_punct_candidates.end ());
-        m_lookup_table.setCursorPos (it - m_punct_candidates.begin ());
+        restoreCursorPos ();
     }
     update();
     return TRUE;
@@ -295,15 +290,7 @@ PunctEditor::moveCursorRight (void)
     if (G_UNLIKELY (m_cursor == m_text.length ()))
         return FALSE;
     m_cursor ++;
-    updatePunctCandidates (m_text[m_cursor - 1]);
-
-    /* restore cursor pos */
-    std::vector<const gchar *>::iterator it;
-    it = std::find (m_punct_candidates.begin (),
-                    m_punct_candidates.end (),
-                    m_selected_puncts[m_cursor - 1]);
-    g_assert (it != m_punct_candidates.end ());
-    m_lookup_table.setCursorPos (it - m_punct_candidates.begin ());
+    restoreCursorPos ();
 
     update();
     return TRUE;
@@ -317,8 +304,7 @@ PunctEditor::moveCursorToBegin (void)
 
     g_assert (m_punct_mode == MODE_NORMAL);
     m_cursor = 0;
-    m_punct_candidates.clear ();
-    fillLookupTable ();
+    clearPunctCandidates ();
     update ();
 
     return TRUE;
@@ -332,15 +318,7 @@ PunctEditor::moveCursorToEnd (void)
 
     g_assert (m_punct_mode == MODE_NORMAL);
     m_cursor = m_text.length ();
-    updatePunctCandidates (m_text[m_cursor - 1]);
-
-    /* restore cursor pos */
-    std::vector<const gchar *>::iterator it;
-    it = std::find (m_punct_candidates.begin (),
-                    m_punct_candidates.end (),
-                    m_selected_puncts[m_cursor - 1]);
-    g_assert (it != m_punct_candidates.end ());
-    m_lookup_table.setCursorPos (it - m_punct_candidates.begin ());
+    restoreCursorPos ();
 
     update();
     return TRUE;
@@ -360,19 +338,10 @@ PunctEditor::removeCharBefore (void)
     }
     else {
         if (m_cursor > 0) {
-
-            updatePunctCandidates (m_text[m_cursor - 1]);
-            /* restore cursor pos */
-            std::vector<const gchar *>::iterator it;
-            it = std::find (m_punct_candidates.begin (),
-                            m_punct_candidates.end (),
-                            m_selected_puncts[m_cursor - 1]);
-            g_assert (it != m_punct_candidates.end ());
-            m_lookup_table.setCursorPos (it - m_punct_candidates.begin ());
+            restoreCursorPos ();
         }
         else {
-            m_punct_candidates.clear ();
-            fillLookupTable ();
+            clearPunctCandidates ();
         }
     }
 
@@ -402,8 +371,7 @@ PunctEditor::reset (void)
 {
     m_punct_mode = MODE_DISABLE;
     m_selected_puncts.clear ();
-    m_punct_candidates.clear ();
-    fillLookupTable ();
+    clearPunctCandidates ();
     Editor::reset ();
 }
 
@@ -425,9 +393,8 @@ void
 PunctEditor::commit (void)
 {
     m_buffer.clear ();
-    for (std::vector<const gchar *>::iterator it = m_selected_puncts.begin ();
-         it != m_selected_puncts.end (); it++) {
-        m_buffer << *it;
+    for (guint i = 0; i < m_selected_puncts.size (); i++) {
+        m_buffer << selectedPunct (i);
     }
 
     commit (m_buffer);
@@ -441,14 +408,14 @@ PunctEditor::selectCandidate (guint i)
         {
             g_assert (m_cursor == 1);
             m_lookup_table.setCursorPos (i);
-            m_selected_puncts[m_cursor - 1] = m_punct_candidates[i];
+            m_selected_puncts[m_cursor - 1] = i;
             commit ();
             return TRUE;
         }
     case MODE_NORMAL:
         {
             m_lookup_table.setCursorPos (i);
-            m_selected_puncts[m_cursor - 1] = m_punct_candidates[i];
+            m_selected_puncts[m_cursor - 1] = i;
 
             /* if it is the last punct, commit the result */
             if (m_cursor == m_text.length ()) {
@@ -483,6 +450,7 @@ PunctEditor::selectCandidateInPage (guint i)
 void
 PunctEditor::update (void)
 {
+    PY_TRACE ("PunctEditor::update", "editor");
     updateLookupTable ();
     updatePreeditText ();
     updateAuxiliaryText ();
@@ -495,11 +463,23 @@ PunctEditor::fillLookupTable (void)
     m_lookup_table.setPageSize (m_config.pageSize ());
     m_lookup_table.setOrientation (m_config.orientation ());
 
-    for (std::vector<const gchar *>::iterator it = m_punct_candidates.begin ();
-         it != m_punct_candidates.end (); it++) {
-        StaticText text (*it);
-        // text.appendAttribute (IBUS_ATTR_TYPE_FOREGROUND, 0x004466, 0, -1);
-        m_lookup_table.appendCandidate (text);
+    if (m_punct_candidates == NULL)
+        return;
+
+    std::vector<Text> & texts = m_punct_texts[m_punct_key];
+    if (G_UNLIKELY (texts.empty ())) {
+        for (const gchar * const *p = m_punct_candidates; *p != NULL; p++) {
+            StaticText text (*p);
+            // text.appendAttribute (IBUS_ATTR_TYPE_FOREGROUND, 0x004466, 0, -1);
+            texts.push_back (text);
+        }
+    }
+
+    /* the lookup table keeps its storage across clear,
+     * so only references of the cached texts are taken here */
+    for (std::vector<Text>::iterator it = texts.begin ();
+         it != texts.end (); it++) {
+        m_lookup_table.appendCandidate (*it);
     }
 }
 
@@ -514,35 +494,51 @@ PunctEditor::updateLookupTable (void)
     }
 }
 
-static int
-punct_cmp (const void *p1, const void *p2)
+void
+PunctEditor::updatePunctCandidates (gchar ch)
 {
-    const gint s1 = (gint)(glong) p1;
-    const gchar *s2 = **(gchar ***) p2;
-    return s1 - s2[0];
+    guint key = (guchar) ch;
+
+    /* the same key keeps its candidates, only the cursor is reset */
+    if (key == m_punct_key) {
+        m_lookup_table.setCursorPos (0);
+        return;
+    }
+
+    if (G_UNLIKELY (key >= G_N_ELEMENTS (punct_table) ||
+                    punct_table[key] == NULL)) {
+        clearPunctCandidates ();
+        return;
+    }
+
+    m_punct_key = key;
+    m_punct_candidates = punct_table[key] + 1;
+    fillLookupTable ();
 }
 
 void
-PunctEditor::updatePunctCandidates (gchar ch)
+PunctEditor::clearPunctCandidates (void)
 {
-    const gchar *** brs;
-    const gchar ** res;
-
-    m_punct_candidates.clear();
-
-    brs = (const gchar ***) std::bsearch (reinterpret_cast<void *>(ch),
-                                          punct_table,
-                                          G_N_ELEMENTS (punct_table),
-                                          sizeof(punct_table[0]),
-                                          punct_cmp);
-    if (brs != NULL) {
-        for (res = (*brs) + 1; *res != NULL; ++res) {
-            m_punct_candidates.push_back (*res);
-        }
-    }
+    m_punct_key = G_MAXUINT;
+    m_punct_candidates = NULL;
     fillLookupTable ();
 }
 
+const gchar *
+PunctEditor::selectedPunct (guint i) const
+{
+    /* the grave key itself selects from the candidates of key 0 */
+    guint key = m_punct_mode == MODE_INIT ? 0 : (guchar) m_text.c_str ()[i];
+    return punct_table[key][1 + m_selected_puncts[i]];
+}
+
+void
+PunctEditor::restoreCursorPos (void)
+{
+    updatePunctCandidates (m_text[m_cursor - 1]);
+    m_lookup_table.setCursorPos (m_selected_puncts[m_cursor - 1]);
+}
+
 void
 PunctEditor::updateAuxiliaryText (void)
 {
@@ -591,7 +587,7 @@ PunctEditor::updatePreeditText (void)
         break;
     case MODE_INIT:
         {
-            m_buffer = m_punct_candidates[m_lookup_table.cursorPos ()];
+            m_buffer = selectedPunct (0);
             StaticText preedit_text (m_buffer);
             /* underline */
             preedit_text.appendAttribute (IBUS_ATTR_TYPE_UNDERLINE, IBUS_ATTR_UNDERLINE_SINGLE, 0, -1);
@@ -601,9 +597,8 @@ PunctEditor::updatePreeditText (void)
     case MODE_NORMAL:
         {
             m_buffer.clear ();
-            for (std::vector<const gchar *>::iterator it = m_selected_puncts.begin ();
-                 it != m_selected_puncts.end (); it++) {
-                m_buffer << *it;
+            for (guint i = 0; i < m_selected_puncts.size (); i++) {
+                m_buffer << selectedPunct (i);
             }
             StaticText preedit_text (m_buffer);
             /* underline */
@@ -41,6 +41,10 @@ public:
     virtual void update (void);
     virtual void reset (void);
     virtual void candidateClicked (guint index, guint button, guint state);
+    virtual gboolean dirty (void) const
+    {
+        return m_punct_mode != MODE_DISABLE || Editor::dirty ();
+    }
 
     virtual gboolean processPunct (guint keyval, guint keycode, guint modifiers);
     virtual gboolean processSpace (guint keyval, guint keycode, guint modifiers);
@@ -61,7 +65,11 @@ public:
 
     void fillLookupTable (void);
     void updatePunctCandidates (gchar ch);
+    void clearPunctCandidates (void);
 protected:
+    const gchar *selectedPunct (guint i) const;
+    void restoreCursorPos (void);
+
     enum {
         MODE_DISABLE,
         MODE_INIT,
@@ -69,8 +77,13 @@ protected:
     } m_punct_mode;
     LookupTable m_lookup_table;
     String m_buffer;
-    std::vector<const gchar *> m_selected_puncts;
-    std::vector<const gchar *> m_punct_candidates;
+    /* index of the selected candidate of each punct key */
+    std::vector<guint> m_selected_puncts;
+    /* candidates of the current key, into punct_table */
+    const gchar * const *m_punct_candidates;
+    guint m_punct_key;
+    /* prebuilt candidate texts, indexed by the punct key */
+    std::vector<Text> m_punct_texts[128];
 
 };
 
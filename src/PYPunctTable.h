@@ -98,8 +98,40 @@ puncts[] = {
 };
 
 static const gchar * const * const
-punct_table[] = {
+punct_table[128] = {
     &puncts[0],    // ""
+    NULL,           // 0x01
+    NULL,           // 0x02
+    NULL,           // 0x03
+    NULL,           // 0x04
+    NULL,           // 0x05
+    NULL,           // 0x06
+    NULL,           // 0x07
+    NULL,           // 0x08
+    NULL,           // 0x09
+    NULL,           // 0x0a
+    NULL,           // 0x0b
+    NULL,           // 0x0c
+    NULL,           // 0x0d
+    NULL,           // 0x0e
+    NULL,           // 0x0f
+    NULL,           // 0x10
+    NULL,           // 0x11
+    NULL,           // 0x12
+    NULL,           // 0x13
+    NULL,           // 0x14
+    NULL,           // 0x15
+    NULL,           // 0x16
+    NULL,           // 0x17
+    NULL,           // 0x18
+    NULL,           // 0x19
+    NULL,           // 0x1a
+    NULL,           // 0x1b
+    NULL,           // 0x1c
+    NULL,           // 0x1d
+    NULL,           // 0x1e
+    NULL,           // 0x1f
+    NULL,           // 0x20
     &puncts[12],    // "!"
     &puncts[18],    // "\""
     &puncts[23],    // "#"
@@ -194,4 +226,5 @@ punct_table[] = {
     &puncts[460],    // "|"
     &puncts[471],    // "}"
     &puncts[479],    // "~"
+    NULL,           // 0x7f
 };
@@ -0,0 +1,471 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PYServer.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <gio/gio.h>
+#include <glib-unix.h>
+#include <pinyin.h>
+#include "PYString.h"
+#include "PYLibPinyin.h"
+#include "PYBatchConverter.h"
+
+namespace PY {
+
+/* same defaults as the batch mode. */
+static const pinyin_option_t SERVER_PINYIN_OPTION =
+        PINYIN_INCOMPLETE |
+        ZHUYIN_INCOMPLETE |
+        PINYIN_CORRECT_ALL |
+        0;
+
+/* requests larger than this are treated as a broken client. */
+#define SERVER_MAX_FRAME (64 * 1024)
+
+/* internal opcode, releases the instances of a closed connection. */
+#define SERVER_OP_CLOSE 0
+
+/* libpinyin contexts are not thread safe, so the connection threads
+ * only do the socket io, and hand every request over to the main
+ * thread, which also runs the user database save timer. */
+struct ServerConnection {
+    const ServerOptions *options;
+
+    BatchConverter::Scheme scheme;
+    pinyin_instance_t *pinyin;
+    pinyin_instance_t *chewing;
+
+    /* the request being handled by the main thread. */
+    guint8 opcode;
+    const gchar *argument;
+    guint8 status;
+    String reply;
+
+    GMutex lock;
+    GCond cond;
+    gboolean done;
+};
+
+static pinyin_instance_t *
+server_instance (ServerConnection *conn)
+{
+    LibPinyinBackEnd & backend = LibPinyinBackEnd::instance ();
+    std::string dicts = conn->options->dictionaries ?
+        conn->options->dictionaries : "";
+
+    if (conn->scheme == BatchConverter::SCHEME_BOPOMOFO) {
+        if (conn->chewing == NULL)
+            conn->chewing = backend.allocChewingInstance
+                (dicts, SERVER_PINYIN_OPTION, ZHUYIN_DEFAULT);
+        return conn->chewing;
+    }
+
+    if (conn->pinyin == NULL)
+        conn->pinyin = backend.allocPinyinInstance
+            (dicts, SERVER_PINYIN_OPTION, DOUBLE_PINYIN_DEFAULT);
+    return conn->pinyin;
+}
+
+/* parses a decimal argument no larger than max. */
+static gboolean
+server_parse_number (const gchar *argument, guint64 max, guint64 & value)
+{
+    if (!g_ascii_isdigit (argument[0]))
+        return FALSE;
+
+    gchar *end = NULL;
+    errno = 0;
+    value = g_ascii_strtoull (argument, &end, 10);
+    return errno == 0 && *end == '\0' && value <= max;
+}
+
+/* parses an nbest index, which must name an existing sentence. */
+static gboolean
+server_parse_sentence_index (ServerConnection *conn,
+                             pinyin_instance_t *instance,
+                             guint8 & index)
+{
+    guint64 value = 0;
+    if (!server_parse_number (conn->argument, G_MAXUINT8, value)) {
+        conn->status = SERVER_STATUS_ERROR;
+        conn->reply << "invalid index";
+        return FALSE;
+    }
+
+    gchar *sentence = NULL;
+    if (!pinyin_get_sentence (instance, value, &sentence) ||
+        sentence == NULL) {
+        conn->status = SERVER_STATUS_ERROR;
+        conn->reply << "no sentence";
+        return FALSE;
+    }
+    g_free (sentence);
+
+    index = value;
+    return TRUE;
+}
+
+static void
+server_handle (ServerConnection *conn)
+{
+    LibPinyinBackEnd & backend = LibPinyinBackEnd::instance ();
+
+    conn->status = SERVER_STATUS_OK;
+    conn->reply.clear ();
+
+    if (conn->opcode == SERVER_OP_CLOSE) {
+        if (conn->pinyin)
+            backend.freePinyinInstance (conn->pinyin);
+        if (conn->chewing)
+            backend.freeChewingInstance (conn->chewing);
+        conn->pinyin = conn->chewing = NULL;
+        return;
+    }
+
+    if (conn->opcode == SERVER_OP_SCHEME) {
+        if (!BatchConverter::parseScheme (conn->argument, conn->scheme)) {
+            conn->status = SERVER_STATUS_ERROR;
+            conn->reply << "unknown scheme";
+        }
+        return;
+    }
+
+    pinyin_instance_t *instance = server_instance (conn);
+    if (instance == NULL) {
+        conn->status = SERVER_STATUS_ERROR;
+        conn->reply << "no pinyin context";
+        return;
+    }
+
+    switch (conn->opcode) {
+    case SERVER_OP_PARSE:
+        {
+            size_t len = 0;
+            pinyin_reset (instance);
+            switch (conn->scheme) {
+            case BatchConverter::SCHEME_FULL_PINYIN:
+                len = pinyin_parse_more_full_pinyins (instance, conn->argument);
+                break;
+            case BatchConverter::SCHEME_DOUBLE_PINYIN:
+                len = pinyin_parse_more_double_pinyins (instance, conn->argument);
+                break;
+            case BatchConverter::SCHEME_BOPOMOFO:
+                len = pinyin_parse_more_chewings (instance, conn->argument);
+                break;
+            }
+            pinyin_guess_sentence (instance);
+            conn->reply.appendPrintf ("%u", (guint) len);
+        }
+        break;
+    case SERVER_OP_SENTENCE:
+        {
+            guint8 index = 0;
+            if (!server_parse_sentence_index (conn, instance, index))
+                break;
+
+            gchar *sentence = NULL;
+            pinyin_get_sentence (instance, index, &sentence);
+            conn->reply << sentence;
+            g_free (sentence);
+        }
+        break;
+    case SERVER_OP_CANDIDATES:
+        {
+            guint len = 0;
+            guint64 limit = G_MAXUINT;
+            if (conn->argument[0] &&
+                !server_parse_number (conn->argument, G_MAXUINT, limit)) {
+                conn->status = SERVER_STATUS_ERROR;
+                conn->reply << "invalid count";
+                break;
+            }
+            pinyin_guess_candidates (instance, 0);
+            pinyin_get_n_candidate (instance, &len);
+            for (guint i = 0; i < len && i < limit; i++) {
+                lookup_candidate_t *candidate = NULL;
+                const gchar *phrase = NULL;
+                pinyin_get_candidate (instance, i, &candidate);
+                pinyin_get_candidate_string (instance, candidate, &phrase);
+                if (i)
+                    conn->reply << '\n';
+                conn->reply << phrase;
+            }
+        }
+        break;
+    case SERVER_OP_TRAIN:
+        {
+            guint8 index = 0;
+            if (!server_parse_sentence_index (conn, instance, index))
+                break;
+
+            pinyin_train (instance, index);
+            backend.modified ();
+        }
+        break;
+    default:
+        conn->status = SERVER_STATUS_UNKNOWN_OPCODE;
+        break;
+    }
+}
+
+static gboolean
+server_dispatch (gpointer data)
+{
+    ServerConnection *conn = static_cast<ServerConnection *> (data);
+
+    server_handle (conn);
+
+    g_mutex_lock (&conn->lock);
+    conn->done = TRUE;
+    g_cond_signal (&conn->cond);
+    g_mutex_unlock (&conn->lock);
+    return FALSE;
+}
+
+/* run one request on the main thread and wait for the reply. */
+static void
+server_call (ServerConnection *conn, guint8 opcode, const gchar *argument)
+{
+    conn->opcode = opcode;
+    conn->argument = argument;
+    conn->done = FALSE;
+
+    g_main_context_invoke (NULL, server_dispatch, conn);
+
+    g_mutex_lock (&conn->lock);
+    while (!conn->done)
+        g_cond_wait (&conn->cond, &conn->lock);
+    g_mutex_unlock (&conn->lock);
+}
+
+static gboolean
+server_read (GInputStream *input, void *buffer, gsize count)
+{
+    gsize bytes_read = 0;
+    if (!g_input_stream_read_all (input, buffer, count, &bytes_read,
+                                  NULL, NULL))
+        return FALSE;
+    return bytes_read == count;
+}
+
+static gboolean
+server_run_connection (GThreadedSocketService *service,
+                       GSocketConnection *connection,
+                       GObject *source_object,
+                       gpointer user_data)
+{
+    ServerConnection conn;
+    conn.options = static_cast<const ServerOptions *> (user_data);
+    conn.scheme = BatchConverter::SCHEME_FULL_PINYIN;
+    conn.pinyin = conn.chewing = NULL;
+    g_mutex_init (&conn.lock);
+    g_cond_init (&conn.cond);
+
+    /* buffered streams, so that pipelined requests are read in
+     * one go and their replies are flushed together. */
+    GIOStream *stream = G_IO_STREAM (connection);
+    GInputStream *input = g_buffered_input_stream_new
+        (g_io_stream_get_input_stream (stream));
+    GOutputStream *output = g_buffered_output_stream_new
+        (g_io_stream_get_output_stream (stream));
+
+    std::string request;
+    while (TRUE) {
+        guint32 length;
+        if (!server_read (input, &length, sizeof (length)))
+            break;
+        length = GUINT32_FROM_BE (length);
+        if (length == 0 || length > SERVER_MAX_FRAME)
+            break;
+
+        request.resize (length);
+        if (!server_read (input, &request[0], length))
+            break;
+
+        const gchar *argument = request.c_str () + 1;
+        if (!g_utf8_validate (argument, length - 1, NULL)) {
+            conn.status = SERVER_STATUS_ERROR;
+            conn.reply = "invalid utf-8";
+        } else {
+            server_call (&conn, request[0], argument);
+        }
+
+        guint32 header = GUINT32_TO_BE (conn.reply.size () + 1);
+        if (!g_output_stream_write_all (output, &header, sizeof (header),
+                                        NULL, NULL, NULL) ||
+            !g_output_stream_write_all (output, &conn.status, 1,
+                                        NULL, NULL, NULL) ||
+            !g_output_stream_write_all (output, conn.reply.c_str (),
+                                        conn.reply.size (),
+                                        NULL, NULL, NULL))
+            break;
+
+        if (g_buffered_input_stream_get_available
+            (G_BUFFERED_INPUT_STREAM (input)) == 0 &&
+            !g_output_stream_flush (output, NULL, NULL))
+            break;
+    }
+
+    server_call (&conn, SERVER_OP_CLOSE, "");
+
+    g_object_unref (input);
+    g_object_unref (output);
+    g_mutex_clear (&conn.lock);
+    g_cond_clear (&conn.cond);
+    return TRUE;
+}
+
+/* removes the socket of a server that is gone, but never the
+ * socket of a running one or a file that is not a socket. */
+static gboolean
+server_remove_stale_socket (const struct sockaddr_un & addr)
+{
+    struct stat st;
+    if (lstat (addr.sun_path, &st) != 0) {
+        if (errno == ENOENT)
+            return TRUE;
+        g_printerr ("can not stat %s: %s\n",
+                    addr.sun_path, g_strerror (errno));
+        return FALSE;
+    }
+
+    if (!S_ISSOCK (st.st_mode)) {
+        g_printerr ("%s exists and is not a socket.\n", addr.sun_path);
+        return FALSE;
+    }
+
+    int fd = socket (AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        g_printerr ("can not create a socket: %s\n", g_strerror (errno));
+        return FALSE;
+    }
+    int retval = connect (fd, (const struct sockaddr *) &addr, sizeof (addr));
+    int saved_errno = errno;
+    close (fd);
+
+    if (retval == 0) {
+        g_printerr ("a server is already running on %s.\n", addr.sun_path);
+        return FALSE;
+    }
+    if (saved_errno != ECONNREFUSED) {
+        g_printerr ("can not check %s: %s\n",
+                    addr.sun_path, g_strerror (saved_errno));
+        return FALSE;
+    }
+
+    return unlink (addr.sun_path) == 0 || errno == ENOENT;
+}
+
+static gboolean
+server_quit (gpointer data)
+{
+    g_main_loop_quit (static_cast<GMainLoop *> (data));
+    return TRUE;
+}
+
+gint
+server_run (const ServerOptions & options)
+{
+    struct sockaddr_un addr;
+    if (strlen (options.path) >= sizeof (addr.sun_path)) {
+        g_printerr ("socket path is too long: %s\n", options.path);
+        return 1;
+    }
+
+    /* the running engine keeps its user tables open and saves them
+       over the ones trained here, so the server has its own. */
+    LibPinyinBackEnd & backend = LibPinyinBackEnd::instance ();
+    backend.setUserDirectorySuffix ("-server");
+
+    /* load the contexts before accepting any client. */
+    std::string dicts = options.dictionaries ? options.dictionaries : "";
+    pinyin_instance_t *pinyin = backend.allocPinyinInstance
+        (dicts, SERVER_PINYIN_OPTION, DOUBLE_PINYIN_DEFAULT);
+    pinyin_instance_t *chewing = backend.allocChewingInstance
+        (dicts, SERVER_PINYIN_OPTION, ZHUYIN_DEFAULT);
+    if (pinyin == NULL || chewing == NULL) {
+        g_printerr ("can not load the pinyin contexts.\n");
+        return 1;
+    }
+    backend.freePinyinInstance (pinyin);
+    backend.freeChewingInstance (chewing);
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, options.path);
+    if (!server_remove_stale_socket (addr))
+        return 1;
+
+    GSocketAddress *address =
+        g_socket_address_new_from_native (&addr, sizeof (addr));
+    GSocketService *service =
+        g_threaded_socket_service_new (options.max_connections);
+
+    /* only the user may convert with the user database,
+       so the socket is created without access for others. */
+    mode_t mask = umask (S_IRWXG | S_IRWXO | S_IXUSR);
+    GError *error = NULL;
+    gboolean listening =
+        g_socket_listener_add_address (G_SOCKET_LISTENER (service),
+                                       address,
+                                       G_SOCKET_TYPE_STREAM,
+                                       G_SOCKET_PROTOCOL_DEFAULT,
+                                       NULL, NULL, &error);
+    umask (mask);
+    if (!listening) {
+        g_printerr ("can not listen on %s: %s\n",
+                    options.path, error->message);
+        g_error_free (error);
+        g_object_unref (address);
+        g_object_unref (service);
+        return 1;
+    }
+    g_object_unref (address);
+
+    g_signal_connect (service, "run",
+                      G_CALLBACK (server_run_connection),
+                      const_cast<ServerOptions *> (&options));
+    g_socket_service_start (service);
+
+    /* leave the main loop on SIGTERM, so the socket is removed. */
+    GMainLoop *loop = g_main_loop_new (NULL, FALSE);
+    guint sigterm_id = g_unix_signal_add (SIGTERM, server_quit, loop);
+    guint sigint_id = g_unix_signal_add (SIGINT, server_quit, loop);
+    g_main_loop_run (loop);
+    g_source_remove (sigterm_id);
+    g_source_remove (sigint_id);
+
+    g_main_loop_unref (loop);
+    g_socket_service_stop (service);
+    g_object_unref (service);
+    unlink (options.path);
+    return 0;
+}
+
+};
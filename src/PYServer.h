@@ -0,0 +1,68 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __PY_SERVER_H_
+#define __PY_SERVER_H_
+
+#include <glib.h>
+
+namespace PY {
+
+/* The --server mode keeps the libpinyin contexts loaded and converts
+ * for local clients over a UNIX socket.
+ *
+ * Every request and reply is a frame of a 32 bit big endian length
+ * followed by that many bytes.  A request starts with an opcode byte,
+ * a reply with a status byte, the rest is an UTF-8 string.  Requests
+ * can be pipelined, replies come back in the same order.
+ *
+ * Each connection owns its own pinyin instance, so the parse state
+ * is kept between requests of the same connection.  SERVER_OP_TRAIN
+ * learns into the user tables of the server, in ibus/libpinyin-server
+ * and ibus/libbopomofo-server of the user cache directory, apart from
+ * the ones of the engine.
+ */
+enum ServerOpcode {
+    SERVER_OP_PARSE = 1,        // keys, reply is the parsed length
+    SERVER_OP_SENTENCE,         // nbest index, reply is the sentence
+    SERVER_OP_CANDIDATES,       // max count, reply is one per line
+    SERVER_OP_TRAIN,            // nbest index, learn the sentence
+    SERVER_OP_SCHEME,           // pinyin, double_pinyin or bopomofo
+};
+
+enum ServerStatus {
+    SERVER_STATUS_OK = 0,
+    SERVER_STATUS_ERROR,
+    SERVER_STATUS_UNKNOWN_OPCODE,
+};
+
+struct ServerOptions {
+    const gchar *path;          // socket file name
+    const gchar *dictionaries;
+    gint max_connections;
+};
+
+/* run the server mode until killed, returns the exit status. */
+gint server_run (const ServerOptions & options);
+
+};
+
+#endif
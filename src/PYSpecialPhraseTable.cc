@@ -0,0 +1,624 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PYSpecialPhraseTable.h"
+
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include "PYTrace.h"
+
+namespace PY {
+
+std::unique_ptr<SpecialPhraseTable> SpecialPhraseTable::m_instance;
+
+/* The trie file is a cache, so it is in the native byte order:
+ * the header, the nodes, the edges, the string offsets of the
+ * phrases and the strings. Node 0 is the root.
+ */
+#define SPECIAL_PHRASE_MAGIC "PYSP"
+#define SPECIAL_PHRASE_VERSION 3
+
+struct SpecialPhraseHeader {
+    gchar magic[4];
+    guint32 version;
+    guint64 stamp;              /* of the sources it is compiled from. */
+    guint32 n_nodes;
+    guint32 n_edges;
+    guint32 n_phrases;
+    guint32 strings_size;
+};
+
+/* the edges of a node are consecutive, sorted by label. */
+struct SpecialPhraseNode {
+    guint32 edges;
+    guint32 n_edges;
+    guint32 phrases;
+    guint32 n_phrases;
+};
+
+struct SpecialPhraseEdge {
+    guint32 label;
+    guint32 child;
+};
+
+/* read the sources, missing ones are empty, and return their stamp,
+ * the trie file is valid for the same contents of the sources. */
+static guint64
+read_sources (const std::vector<std::string> & sources,
+              std::vector<std::string> *contents)
+{
+    GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA1);
+    for (guint i = 0; i < sources.size (); i++) {
+        gchar *data = NULL;
+        gsize length = 0;
+        if (!g_file_get_contents (sources[i].c_str (), &data, &length, NULL))
+            length = 0;
+
+        guint64 size = length;
+        g_checksum_update (checksum, (const guchar *) &size, sizeof (size));
+        g_checksum_update (checksum, (const guchar *) data, length);
+        if (contents)
+            contents->push_back (std::string (data ? data : "", length));
+        g_free (data);
+    }
+
+    guint8 digest[20];
+    gsize digest_len = sizeof (digest);
+    g_checksum_get_digest (checksum, digest, &digest_len);
+    g_checksum_free (checksum);
+
+    guint64 stamp;
+    memcpy (&stamp, digest, sizeof (stamp));
+    return stamp;
+}
+
+/* "key=phrase" lines of phrases.txt, and "key = "phrase","phrase""
+ * lines of special_table, lines starting with ';' or '#' are comments.
+ * The keys are stored after prefix. */
+static void
+parse_phrases (const std::string & contents, const gchar *prefix,
+               std::map<std::string, std::vector<std::string> > & phrases)
+{
+    gchar **lines = g_strsplit (contents.c_str (), "\n", -1);
+
+    for (gchar **line = lines; *line; line++) {
+        gchar *text = g_strstrip (*line);
+        if (text[0] == '\0' || text[0] == ';' || text[0] == '#')
+            continue;
+
+        gchar *equal = strchr (text, '=');
+        if (equal == NULL || equal == text)
+            continue;
+        *equal = '\0';
+        std::string key = prefix;
+        key += g_strstrip (text);
+        gchar *value = g_strstrip (equal + 1);
+        std::vector<std::string> & values = phrases[key];
+
+        if (value[0] != '"') {
+            if (value[0] != '\0')
+                values.push_back (value);
+            continue;
+        }
+
+        /* a list of quoted phrases, X_ phrases are builtins
+         * of ibus-pinyin, which are not supported. */
+        for (gchar *p = value; (p = strchr (p, '"')) != NULL; ) {
+            gchar *end = strchr (p + 1, '"');
+            if (end == NULL)
+                break;
+            std::string phrase (p + 1, end - p - 1);
+            if (!phrase.empty () && !g_str_has_prefix (phrase.c_str (), "X_"))
+                values.push_back (phrase);
+            p = end + 1;
+        }
+    }
+
+    g_strfreev (lines);
+}
+
+gboolean
+SpecialPhraseTable::compile (const std::vector<std::string> & sources,
+                             const gchar *path)
+{
+    PY_TRACE ("SpecialPhraseTable::compile", "phrases");
+
+    /* stamped with the contents it is compiled from. */
+    std::vector<std::string> contents;
+    guint64 stamp = read_sources (sources, &contents);
+
+    std::map<std::string, std::vector<std::string> > phrases;
+    /* the keys of special_table are typed after an "i", as in
+       ibus-pinyin, many of them are plain pinyin otherwise. */
+    for (guint i = 0; i < contents.size (); i++) {
+        gchar *basename = g_path_get_basename (sources[i].c_str ());
+        gboolean special = g_strcmp0 (basename, "special_table") == 0;
+        g_free (basename);
+        parse_phrases (contents[i], special ? "i" : "", phrases);
+    }
+
+    struct BuildNode {
+        std::map<guchar, guint32> children;
+        std::vector<guint32> phrases;
+    };
+    std::vector<BuildNode> trie (1);
+    std::string strings;
+    guint32 n_edges = 0, n_phrases = 0;
+
+    for (auto & entry : phrases) {
+        guint32 node = 0;
+        for (guint i = 0; i < entry.first.size (); i++) {
+            guchar label = entry.first[i];
+            auto child = trie[node].children.find (label);
+            if (child == trie[node].children.end ()) {
+                trie[node].children[label] = trie.size ();
+                node = trie.size ();
+                trie.push_back (BuildNode ());
+                n_edges++;
+            } else {
+                node = child->second;
+            }
+        }
+
+        for (guint i = 0; i < entry.second.size (); i++) {
+            /* the later duplicates of a phrase are dropped. */
+            const std::string & phrase = entry.second[i];
+            if (std::find (entry.second.begin (), entry.second.begin () + i,
+                           phrase) != entry.second.begin () + i)
+                continue;
+            trie[node].phrases.push_back (strings.size ());
+            strings.append (phrase.c_str (), phrase.size () + 1);
+            n_phrases++;
+        }
+    }
+
+    SpecialPhraseHeader header;
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, SPECIAL_PHRASE_MAGIC, sizeof (header.magic));
+    header.version = SPECIAL_PHRASE_VERSION;
+    header.stamp = stamp;
+    header.n_nodes = trie.size ();
+    header.n_edges = n_edges;
+    header.n_phrases = n_phrases;
+    header.strings_size = strings.size ();
+
+    std::vector<SpecialPhraseNode> nodes (trie.size ());
+    std::vector<SpecialPhraseEdge> edges;
+    std::vector<guint32> offsets;
+    edges.reserve (n_edges);
+    offsets.reserve (n_phrases);
+    for (guint32 i = 0; i < trie.size (); i++) {
+        nodes[i].edges = edges.size ();
+        nodes[i].n_edges = trie[i].children.size ();
+        for (auto & child : trie[i].children) {
+            SpecialPhraseEdge edge = { child.first, child.second };
+            edges.push_back (edge);
+        }
+        nodes[i].phrases = offsets.size ();
+        nodes[i].n_phrases = trie[i].phrases.size ();
+        offsets.insert (offsets.end (), trie[i].phrases.begin (),
+                        trie[i].phrases.end ());
+    }
+
+    std::string file;
+    file.reserve (sizeof (header) +
+                  nodes.size () * sizeof (SpecialPhraseNode) +
+                  edges.size () * sizeof (SpecialPhraseEdge) +
+                  offsets.size () * sizeof (guint32) + strings.size ());
+    file.append ((const gchar *) &header, sizeof (header));
+    file.append ((const gchar *) nodes.data (),
+                 nodes.size () * sizeof (SpecialPhraseNode));
+    file.append ((const gchar *) edges.data (),
+                 edges.size () * sizeof (SpecialPhraseEdge));
+    file.append ((const gchar *) offsets.data (),
+                 offsets.size () * sizeof (guint32));
+    file.append (strings);
+
+    /* replaced atomically, the mapped old file stays valid. */
+    return g_file_set_contents (path, file.data (), file.size (), NULL);
+}
+
+SpecialPhraseTable::SpecialPhraseTable ()
+    : m_file (NULL),
+      m_header (NULL),
+      m_nodes (NULL),
+      m_edges (NULL),
+      m_phrases (NULL),
+      m_strings (NULL),
+      m_cancellable (NULL),
+      m_timeout_id (0)
+{
+    m_sources.push_back (PKGDATADIR G_DIR_SEPARATOR_S "phrases.txt");
+    m_sources.push_back (PKGDATADIR G_DIR_SEPARATOR_S "special_table");
+
+    gchar *path = g_build_filename (g_get_user_config_dir (),
+                                    "ibus", "libpinyin", "phrases.txt", NULL);
+    m_sources.push_back (path);
+    g_free (path);
+
+    gchar *dirname = g_build_filename (g_get_user_cache_dir (),
+                                       "ibus", "libpinyin", NULL);
+    g_mkdir_with_parents (dirname, 0700);
+    path = g_build_filename (dirname, "special_phrases.bin", NULL);
+    m_path = path;
+    g_free (path);
+    g_free (dirname);
+
+    /* the trie of the last run is reused when the sources are unchanged. */
+    if (!load ())
+        rebuild ();
+
+    for (guint i = 0; i < m_sources.size (); i++) {
+        GFile *file = g_file_new_for_path (m_sources[i].c_str ());
+        GFileMonitor *monitor =
+            g_file_monitor_file (file, G_FILE_MONITOR_NONE, NULL, NULL);
+        g_object_unref (file);
+        if (monitor == NULL)
+            continue;
+        g_signal_connect (monitor, "changed",
+                          G_CALLBACK (changedCallback), this);
+        m_monitors.push_back (monitor);
+    }
+}
+
+SpecialPhraseTable::~SpecialPhraseTable ()
+{
+    for (guint i = 0; i < m_monitors.size (); i++) {
+        g_signal_handlers_disconnect_by_data (m_monitors[i], this);
+        g_object_unref (m_monitors[i]);
+    }
+
+    if (m_timeout_id != 0)
+        g_source_remove (m_timeout_id);
+
+    /* the pending rebuild won't call back into this table. */
+    if (m_cancellable) {
+        g_cancellable_cancel (m_cancellable);
+        g_object_unref (m_cancellable);
+    }
+
+    unload ();
+}
+
+gboolean
+SpecialPhraseTable::load (void)
+{
+    PY_TRACE ("SpecialPhraseTable::load", "phrases");
+
+    GMappedFile *file = g_mapped_file_new (m_path.c_str (), FALSE, NULL);
+    if (file == NULL)
+        return FALSE;
+
+    gsize length = g_mapped_file_get_length (file);
+    const gchar *contents = g_mapped_file_get_contents (file);
+    const SpecialPhraseHeader *header = (const SpecialPhraseHeader *) contents;
+
+    if (length < sizeof (SpecialPhraseHeader) ||
+        memcmp (header->magic, SPECIAL_PHRASE_MAGIC, sizeof (header->magic)) != 0 ||
+        header->version != SPECIAL_PHRASE_VERSION ||
+        header->stamp != read_sources (m_sources, NULL) ||
+        length != sizeof (SpecialPhraseHeader) +
+                  (guint64) header->n_nodes * sizeof (SpecialPhraseNode) +
+                  (guint64) header->n_edges * sizeof (SpecialPhraseEdge) +
+                  (guint64) header->n_phrases * sizeof (guint32) +
+                  header->strings_size) {
+        g_mapped_file_unref (file);
+        return FALSE;
+    }
+
+    const SpecialPhraseNode *nodes = (const SpecialPhraseNode *) (header + 1);
+    const SpecialPhraseEdge *edges = (const SpecialPhraseEdge *) (nodes + header->n_nodes);
+    const guint32 *phrases = (const guint32 *) (edges + header->n_edges);
+    const gchar *strings = (const gchar *) (phrases + header->n_phrases);
+
+    if (!validate (header, nodes, edges, phrases, strings)) {
+        g_warning ("invalid special phrases file %s, rebuilding it.",
+                   m_path.c_str ());
+        g_mapped_file_unref (file);
+        return FALSE;
+    }
+
+    unload ();
+
+    m_file = file;
+    m_header = header;
+    m_nodes = nodes;
+    m_edges = edges;
+    m_phrases = phrases;
+    m_strings = strings;
+    return TRUE;
+}
+
+/* lookup trusts every index and offset of the trie file. */
+gboolean
+SpecialPhraseTable::validate (const SpecialPhraseHeader *header,
+                              const SpecialPhraseNode *nodes,
+                              const SpecialPhraseEdge *edges,
+                              const guint32 *phrases,
+                              const gchar *strings)
+{
+    /* the root is always there. */
+    if (header->n_nodes == 0)
+        return FALSE;
+
+    for (guint32 i = 0; i < header->n_nodes; i++) {
+        if ((guint64) nodes[i].edges + nodes[i].n_edges > header->n_edges ||
+            (guint64) nodes[i].phrases + nodes[i].n_phrases > header->n_phrases)
+            return FALSE;
+    }
+
+    for (guint32 i = 0; i < header->n_edges; i++) {
+        if (edges[i].label > G_MAXUINT8 || edges[i].child >= header->n_nodes)
+            return FALSE;
+    }
+
+    for (guint32 i = 0; i < header->n_phrases; i++) {
+        if (phrases[i] >= header->strings_size)
+            return FALSE;
+    }
+
+    /* so every phrase ends before the end of the file. */
+    if (header->strings_size != 0 &&
+        strings[header->strings_size - 1] != '\0')
+        return FALSE;
+
+    return TRUE;
+}
+
+void
+SpecialPhraseTable::unload (void)
+{
+    if (m_file)
+        g_mapped_file_unref (m_file);
+    m_file = NULL;
+    m_header = NULL;
+    m_nodes = NULL;
+    m_edges = NULL;
+    m_phrases = NULL;
+    m_strings = NULL;
+}
+
+/* the thread works on copies, as the table may be gone before it ends. */
+struct SpecialPhraseRebuild {
+    std::vector<std::string> sources;
+    std::string path;
+};
+
+static void
+special_phrase_rebuild_free (gpointer data)
+{
+    delete static_cast<SpecialPhraseRebuild *> (data);
+}
+
+void
+SpecialPhraseTable::rebuild (void)
+{
+    if (m_cancellable) {
+        g_cancellable_cancel (m_cancellable);
+        g_object_unref (m_cancellable);
+    }
+    m_cancellable = g_cancellable_new ();
+
+    SpecialPhraseRebuild *data = new SpecialPhraseRebuild;
+    data->sources = m_sources;
+    data->path = m_path;
+
+    GTask *task = g_task_new (NULL, m_cancellable, rebuildReady, this);
+    g_task_set_task_data (task, data, special_phrase_rebuild_free);
+    g_task_run_in_thread (task, rebuildThread);
+    g_object_unref (task);
+}
+
+void
+SpecialPhraseTable::rebuildThread (GTask *task, gpointer source,
+                                   gpointer task_data, GCancellable *cancellable)
+{
+    SpecialPhraseRebuild *data = static_cast<SpecialPhraseRebuild *> (task_data);
+    g_task_return_boolean (task, compile (data->sources, data->path.c_str ()));
+}
+
+void
+SpecialPhraseTable::rebuildReady (GObject *source, GAsyncResult *result,
+                                  gpointer user_data)
+{
+    /* the table may be gone when cancelled. */
+    if (g_cancellable_is_cancelled (g_task_get_cancellable (G_TASK (result))))
+        return;
+
+    SpecialPhraseTable *self = static_cast<SpecialPhraseTable *> (user_data);
+    g_object_unref (self->m_cancellable);
+    self->m_cancellable = NULL;
+    if (g_task_propagate_boolean (G_TASK (result), NULL))
+        self->load ();
+}
+
+void
+SpecialPhraseTable::changedCallback (GFileMonitor *monitor, GFile *file,
+                                     GFile *other, GFileMonitorEvent event,
+                                     gpointer user_data)
+{
+    SpecialPhraseTable *self = static_cast<SpecialPhraseTable *> (user_data);
+
+    if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+        event != G_FILE_MONITOR_EVENT_CREATED &&
+        event != G_FILE_MONITOR_EVENT_DELETED)
+        return;
+
+    /* editors usually write a file in several steps. */
+    if (self->m_timeout_id == 0)
+        self->m_timeout_id = g_timeout_add_seconds (1, timeoutCallback, self);
+}
+
+gboolean
+SpecialPhraseTable::timeoutCallback (gpointer user_data)
+{
+    SpecialPhraseTable *self = static_cast<SpecialPhraseTable *> (user_data);
+    self->m_timeout_id = 0;
+    self->rebuild ();
+    return FALSE;
+}
+
+static const gchar * const cn_digits[] = {
+    "〇", "一", "二", "三", "四", "五", "六", "七", "八", "九",
+};
+
+/* digit by digit, for years. */
+static std::string
+digits_cn (gint n, gint width)
+{
+    gchar *digits = g_strdup_printf ("%0*d", width, n);
+    std::string result;
+    for (const gchar *p = digits; *p; p++)
+        result += cn_digits[*p - '0'];
+    g_free (digits);
+    return result;
+}
+
+/* 0 - 99 as counted, e.g. 十三, 二十二. */
+static std::string
+number_cn (gint n)
+{
+    std::string result;
+    if (n >= 20)
+        result += cn_digits[n / 10];
+    if (n >= 10)
+        result += "十";
+    if (n < 10 || n % 10 != 0)
+        result += cn_digits[n % 10];
+    return result;
+}
+
+static std::string
+dynamic_value (const std::string & name, GDateTime *now)
+{
+    gint year = g_date_time_get_year (now);
+    gint month = g_date_time_get_month (now);
+    gint day = g_date_time_get_day_of_month (now);
+    gint weekday = g_date_time_get_day_of_week (now) % 7;
+    gint hour = g_date_time_get_hour (now);
+    gint halfhour = hour % 12 == 0 ? 12 : hour % 12;
+    gint minute = g_date_time_get_minute (now);
+    gint second = g_date_time_get_second (now);
+    gchar buf[16];
+
+#define FORMAT(fmt, value) \
+    (g_snprintf (buf, sizeof (buf), fmt, value), std::string (buf))
+
+    if (name == "year")         return FORMAT ("%d", year);
+    if (name == "year_yy")      return FORMAT ("%02d", year % 100);
+    if (name == "month")        return FORMAT ("%d", month);
+    if (name == "month_mm")     return FORMAT ("%02d", month);
+    if (name == "day")          return FORMAT ("%d", day);
+    if (name == "day_dd")       return FORMAT ("%02d", day);
+    if (name == "weekday")      return FORMAT ("%d", weekday);
+    if (name == "fullhour")     return FORMAT ("%02d", hour);
+    if (name == "halfhour")     return FORMAT ("%02d", halfhour);
+    if (name == "ampm")         return hour < 12 ? "AM" : "PM";
+    if (name == "minute")       return FORMAT ("%02d", minute);
+    if (name == "second")       return FORMAT ("%02d", second);
+    if (name == "year_cn")      return digits_cn (year, 4);
+    if (name == "year_yy_cn")   return digits_cn (year % 100, 2);
+    if (name == "month_cn")     return number_cn (month);
+    if (name == "day_cn")       return number_cn (day);
+    if (name == "weekday_cn")   return weekday == 0 ? "日" : cn_digits[weekday];
+    if (name == "fullhour_cn")  return number_cn (hour);
+    if (name == "halfhour_cn")  return number_cn (halfhour);
+    if (name == "ampm_cn")      return hour < 12 ? "上午" : "下午";
+    if (name == "minute_cn")    return (minute < 10 ? "零" : "") + number_cn (minute);
+    if (name == "second_cn")    return (second < 10 ? "零" : "") + number_cn (second);
+
+#undef FORMAT
+
+    /* unknown variables are kept. */
+    return "${" + name + "}";
+}
+
+/* expand the ${name} variables of a dynamic phrase. */
+static std::string
+expand_dynamic_phrase (const gchar *phrase)
+{
+    GDateTime *now = g_date_time_new_now_local ();
+    std::string result;
+
+    const gchar *p = phrase;
+    const gchar *begin;
+    while ((begin = strstr (p, "${")) != NULL) {
+        const gchar *end = strchr (begin + 2, '}');
+        if (end == NULL)
+            break;
+        result.append (p, begin - p);
+        result += dynamic_value (std::string (begin + 2, end - begin - 2), now);
+        p = end + 1;
+    }
+    result += p;
+
+    g_date_time_unref (now);
+    return result;
+}
+
+gboolean
+SpecialPhraseTable::lookup (const gchar *key, std::vector<std::string> & result)
+{
+    if (m_header == NULL)
+        return FALSE;
+
+    /* one step per byte of key, each node has at most
+     * one edge per possible input character. */
+    guint32 node = 0;
+    for (const guchar *p = (const guchar *) key; *p; p++) {
+        const SpecialPhraseEdge *edge = m_edges + m_nodes[node].edges;
+        const SpecialPhraseEdge *end = edge + m_nodes[node].n_edges;
+        while (edge < end && edge->label < *p)
+            edge++;
+        if (edge == end || edge->label != *p)
+            return FALSE;
+        node = edge->child;
+    }
+
+    if (m_nodes[node].n_phrases == 0)
+        return FALSE;
+
+    for (guint32 i = 0; i < m_nodes[node].n_phrases; i++) {
+        const gchar *phrase = m_strings + m_phrases[m_nodes[node].phrases + i];
+        /* dynamic phrases start with '#'. */
+        if (phrase[0] == '#')
+            result.push_back (expand_dynamic_phrase (phrase + 1));
+        else
+            result.push_back (phrase);
+    }
+    return TRUE;
+}
+
+void
+SpecialPhraseTable::init (void)
+{
+    g_assert (NULL == m_instance.get ());
+    m_instance.reset (new SpecialPhraseTable);
+}
+
+void
+SpecialPhraseTable::finalize (void)
+{
+    m_instance.reset ();
+}
+
+};
@@ -0,0 +1,102 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __PY_SPECIAL_PHRASE_TABLE_H_
+#define __PY_SPECIAL_PHRASE_TABLE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <gio/gio.h>
+
+namespace PY {
+
+struct SpecialPhraseHeader;
+struct SpecialPhraseNode;
+struct SpecialPhraseEdge;
+
+/* Special phrases from phrases.txt, special_table and the user
+ * phrases.txt, compiled into a trie file in the user cache directory.
+ * The keys of special_table start with an "i", they are typed in the
+ * extension mode.
+ * The trie is mmapped, so it is shared by all engines and read without
+ * parsing, and it is rebuilt in a thread when a source file changes.
+ */
+class SpecialPhraseTable {
+public:
+    SpecialPhraseTable ();
+    ~SpecialPhraseTable ();
+
+    /* append the phrases of key to result, with the dynamic phrases
+     * expanded, walking the trie once over key. */
+    gboolean lookup (const gchar *key, std::vector<std::string> & result);
+
+    /* compile the sources into the trie file at path. */
+    static gboolean compile (const std::vector<std::string> & sources,
+                             const gchar *path);
+
+    /* NULL before init, e.g. in batch mode. */
+    static SpecialPhraseTable * instance (void) { return m_instance.get (); }
+
+    static void init (void);
+    static void finalize (void);
+
+private:
+    gboolean load (void);
+    void unload (void);
+    static gboolean validate (const SpecialPhraseHeader *header,
+                              const SpecialPhraseNode *nodes,
+                              const SpecialPhraseEdge *edges,
+                              const guint32 *phrases,
+                              const gchar *strings);
+    void rebuild (void);
+
+    static void rebuildThread (GTask *task, gpointer source,
+                               gpointer task_data, GCancellable *cancellable);
+    static void rebuildReady (GObject *source, GAsyncResult *result,
+                              gpointer user_data);
+    static void changedCallback (GFileMonitor *monitor, GFile *file,
+                                 GFile *other, GFileMonitorEvent event,
+                                 gpointer user_data);
+    static gboolean timeoutCallback (gpointer user_data);
+
+private:
+    std::vector<std::string> m_sources;
+    std::string m_path;
+
+    GMappedFile *m_file;
+    const SpecialPhraseHeader *m_header;
+    const SpecialPhraseNode *m_nodes;
+    const SpecialPhraseEdge *m_edges;
+    const guint32 *m_phrases;
+    const gchar *m_strings;
+
+    std::vector<GFileMonitor *> m_monitors;
+    GCancellable *m_cancellable;
+    guint m_timeout_id;
+
+private:
+    static std::unique_ptr<SpecialPhraseTable> m_instance;
+};
+
+};
+
+#endif
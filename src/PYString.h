@@ -36,40 +36,54 @@ public:
 
     String & printf (const gchar *fmt, ...)
     {
-        gchar *str;
         va_list args;
 
+        clear ();
         va_start (args, fmt);
-        str = g_strdup_vprintf (fmt, args);
+        appendVPrintf (fmt, args);
         va_end (args);
-
-        assign (str);
-        g_free (str);
         return *this;
     }
 
     String & appendPrintf (const gchar *fmt, ...)
     {
-        gchar *str;
         va_list args;
 
         va_start (args, fmt);
-        str = g_strdup_vprintf (fmt, args);
+        appendVPrintf (fmt, args);
         va_end (args);
+        return *this;
+    }
 
-        append (str);
-        g_free (str);
+    /* format into an uncleared stack buffer and append only the
+     * formatted length, only longer output is formatted twice. */
+    String & appendVPrintf (const gchar *fmt, va_list args)
+    {
+        gchar buffer[256];
+        va_list copy;
+
+        G_VA_COPY (copy, args);
+        gint n = g_vsnprintf (buffer, sizeof (buffer), fmt, copy);
+        va_end (copy);
+
+        if (G_UNLIKELY (n < 0))
+            return *this;
 
+        if (G_LIKELY ((gsize) n < sizeof (buffer))) {
+            append (buffer, n);
+        }
+        else {
+            gsize len = size ();
+            resize (len + n);
+            g_vsnprintf (&std::string::operator[] (len), n + 1, fmt, args);
+        }
         return *this;
     }
 
     String & appendUnichar (gunichar ch)
     {
-        gchar str[12];
-        gint len;
-        len = g_unichar_to_utf8 (ch, str);
-        str[len] = 0;
-        append (str);
+        gchar str[6];
+        append (str, g_unichar_to_utf8 (ch, str));
         return *this;
     }
 
@@ -92,12 +106,16 @@ public:
 
     String & operator<< (gint i)
     {
-        return appendPrintf ("%d", i);
+        if (i < 0) {
+            append (1, '-');
+            return appendDecimal (- (guint) i);
+        }
+        return appendDecimal (i);
     }
 
     String & operator<< (guint i)
     {
-        return appendPrintf ("%u", i);
+        return appendDecimal (i);
     }
 
     String & operator<< (const gchar ch)
@@ -114,17 +132,8 @@ public:
 
     String & operator<< (const gunichar *wstr)
     {
-        gchar *str;
-        GError *error;
-        str = g_ucs4_to_utf8 (wstr, -1, NULL, NULL, &error);
-        if (str == NULL) {
-            g_warning ("convert ucs4 to utf8 failed: %s", error->message);
-            g_error_free (error);
-        }
-        else {
-            append (str);
-            g_free (str);
-        }
+        for (; *wstr != 0; wstr++)
+            appendUnichar (*wstr);
         return *this;
     }
 
@@ -158,6 +167,19 @@ public:
     {
         return ! empty ();
     }
+
+private:
+    String & appendDecimal (guint i)
+    {
+        gchar str[16];
+        gchar *p = str + sizeof (str);
+        do {
+            *--p = '0' + i % 10;
+            i /= 10;
+        } while (i != 0);
+        append (p, str + sizeof (str) - p);
+        return *this;
+    }
 };
 
 };
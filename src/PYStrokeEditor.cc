@@ -28,119 +28,16 @@
 #include <sqlite3.h>
 #include "PYString.h"
 #include "PYConfig.h"
+#include "PYTrace.h"
+#include "PYStrokeDatabase.h"
 
 #define _(text) (gettext (text))
 
 namespace PY {
 
-class StrokeDatabase{
-public:
-    StrokeDatabase(){
-        m_sqlite = NULL;
-        m_sql = "";
-    }
-
-    ~StrokeDatabase(){
-        if (m_sqlite){
-            sqlite3_close (m_sqlite);
-            m_sqlite = NULL;
-        }
-        m_sql = "";
-    }
-
-    gboolean isDatabaseExisted(const char *filename) {
-        gboolean result = g_file_test(filename, G_FILE_TEST_IS_REGULAR);
-        if (!result)
-            return FALSE;
-
-        sqlite3 *tmp_db = NULL;
-        if (sqlite3_open_v2 (filename, &tmp_db,
-                             SQLITE_OPEN_READONLY, NULL) != SQLITE_OK){
-            return FALSE;
-        }
-
-        /* Check the desc table */
-        sqlite3_stmt *stmt = NULL;
-        const char *tail = NULL;
-        m_sql = "SELECT value FROM desc WHERE name = 'version';";
-        result = sqlite3_prepare_v2 (tmp_db, m_sql.c_str(), -1, &stmt, &tail);
-        if (result != SQLITE_OK)
-            return FALSE;
-
-        result = sqlite3_step (stmt);
-        if (result != SQLITE_ROW)
-            return FALSE;
-
-        result = sqlite3_column_type (stmt, 0);
-        if (result != SQLITE_TEXT)
-            return FALSE;
-
-        const char *version = (const char *) sqlite3_column_text (stmt, 0);
-        if (strcmp("1.2.0", version) != 0)
-            return FALSE;
-
-        result = sqlite3_finalize (stmt);
-        g_assert (result == SQLITE_OK);
-        sqlite3_close (tmp_db);
-        return TRUE;
-    }
-
-    /* No self-learning here, and no user database file. */
-    gboolean openDatabase(const char *system_db) {
-        if (!isDatabaseExisted (system_db))
-            return FALSE;
-
-        /* open system database. */
-        if (sqlite3_open_v2 (system_db, &m_sqlite,
-                             SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
-            m_sqlite = NULL;
-            return FALSE;
-        }
-
-        return TRUE;
-    }
-
-    /* List the characters in sequence order. */
-    gboolean listCharacters(const char *prefix,
-                            std::vector<std::string> & characters){
-        sqlite3_stmt *stmt = NULL;
-        const char *tail = NULL;
-        characters.clear ();
-
-        /* list characters */
-        const char *SQL_DB_LIST =
-            "SELECT \"character\", \"token\" FROM \"strokes\""
-            "WHERE \"strokes\" LIKE \"%s%\" ORDER BY \"sequence\" ASC;";
-        m_sql.printf (SQL_DB_LIST, prefix);
-        int result = sqlite3_prepare_v2 (m_sqlite, m_sql.c_str(), -1, &stmt, &tail);
-        if (result != SQLITE_OK)
-            return FALSE;
-
-        result = sqlite3_step (stmt);
-        while (result == SQLITE_ROW){
-            /* get the characters. */
-            result = sqlite3_column_type (stmt, 0);
-            if (result != SQLITE_TEXT)
-                return FALSE;
-
-            const char *character = (const char *)sqlite3_column_text (stmt, 0);
-            characters.push_back (character);
-
-            result = sqlite3_step (stmt);
-        }
-
-        sqlite3_finalize (stmt);
-        if (result != SQLITE_DONE)
-            return FALSE;
-        return TRUE;
-    }
-private:
-    sqlite3 *m_sqlite;
-    String m_sql;
-};
-
 StrokeEditor::StrokeEditor (PinyinProperties &props, Config &config)
-    : Editor (props, config)
+    : Editor (props, config),
+      m_preedit_text (128), m_auxiliary_text (128)
 {
     m_stroke_database = new StrokeDatabase;
 
@@ -159,6 +56,13 @@ StrokeEditor::~StrokeEditor ()
     m_stroke_database = NULL;
 }
 
+gsize
+StrokeEditor::memoryUsage (void) const
+{
+    return Editor::memoryUsage () + sizeof (StrokeDatabase) +
+        m_stroke_database->memoryUsed ();
+}
+
 gboolean
 StrokeEditor::processKeyEvent (guint keyval, guint keycode, guint modifiers)
 {
@@ -450,6 +354,7 @@ StrokeEditor::cursorDown (void)
 void
 StrokeEditor::update (void)
 {
+    PY_TRACE ("StrokeEditor::update", "editor");
     updateLookupTable ();
     updatePreeditText ();
     updateAuxiliaryText ();
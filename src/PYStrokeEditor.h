@@ -42,6 +42,7 @@ public:
     virtual void update (void);
     virtual void reset (void);
     virtual void candidateClicked (guint index, guint button, guint state);
+    virtual gsize memoryUsage (void) const;
 
 private:
     gboolean updateStateFromInput (void);
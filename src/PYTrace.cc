@@ -0,0 +1,209 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "PYTrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace PY {
+
+/* must be a power of two, about 1.5 MiB of events. */
+#define TRACE_RING_SIZE     (1 << 15)
+#define TRACE_RING_MASK     (TRACE_RING_SIZE - 1)
+#define TRACE_FLUSH_TIMEOUT (1)
+
+struct TraceEvent {
+    const gchar *name;
+    const gchar *category;
+    gint64 start;
+    gint64 duration;
+    gint tid;
+};
+
+/* bounded multi-producer queue after Dmitry Vyukov, each cell
+ * carries a sequence number telling whether it is free or filled
+ * for the current lap, so producers only contend on one counter. */
+struct TraceCell {
+    volatile gint sequence;
+    TraceEvent event;
+};
+
+static TraceCell *trace_cells = NULL;
+static volatile gint trace_enqueue_pos = 0;
+static guint trace_dequeue_pos = 0;
+static volatile gint trace_dropped = 0;
+static volatile gint trace_last_tid = 0;
+static GPrivate trace_tid;
+
+static FILE *trace_file = NULL;
+static gboolean trace_first = TRUE;
+static guint trace_timeout_id = 0;
+
+gboolean Trace::m_enabled = FALSE;
+
+/* small per thread numbers read better than pointers in the viewer. */
+static gint
+trace_thread_id (void)
+{
+    gint tid = GPOINTER_TO_INT (g_private_get (&trace_tid));
+    if (G_UNLIKELY (tid == 0)) {
+        tid = g_atomic_int_add (&trace_last_tid, 1) + 1;
+        g_private_set (&trace_tid, GINT_TO_POINTER (tid));
+    }
+    return tid;
+}
+
+void
+Trace::complete (const gchar *name, const gchar *category,
+                 gint64 start, gint64 duration)
+{
+    if (!m_enabled)
+        return;
+
+    TraceCell *cell;
+    guint pos = g_atomic_int_get (&trace_enqueue_pos);
+    while (TRUE) {
+        cell = &trace_cells[pos & TRACE_RING_MASK];
+        guint sequence = g_atomic_int_get (&cell->sequence);
+        gint diff = (gint) (sequence - pos);
+
+        if (diff == 0) {
+            if (g_atomic_int_compare_and_exchange (&trace_enqueue_pos,
+                                                   pos, pos + 1))
+                break;
+            pos = g_atomic_int_get (&trace_enqueue_pos);
+        } else if (diff < 0) {
+            /* full, the flush timer did not keep up. */
+            g_atomic_int_inc (&trace_dropped);
+            return;
+        } else {
+            pos = g_atomic_int_get (&trace_enqueue_pos);
+        }
+    }
+
+    cell->event.name = name;
+    cell->event.category = category;
+    cell->event.start = start;
+    cell->event.duration = duration;
+    cell->event.tid = trace_thread_id ();
+    g_atomic_int_set (&cell->sequence, pos + 1);
+}
+
+void
+Trace::flush (void)
+{
+    if (trace_file == NULL)
+        return;
+
+    gint pid = getpid ();
+    while (TRUE) {
+        guint pos = trace_dequeue_pos;
+        TraceCell *cell = &trace_cells[pos & TRACE_RING_MASK];
+        guint sequence = g_atomic_int_get (&cell->sequence);
+        if ((gint) (sequence - (pos + 1)) < 0)
+            break;
+
+        const TraceEvent & event = cell->event;
+        fprintf (trace_file,
+                 "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                 "\"ts\":%" G_GINT64_FORMAT ",\"dur\":%" G_GINT64_FORMAT ","
+                 "\"pid\":%d,\"tid\":%d}",
+                 trace_first ? "" : ",\n",
+                 event.name, event.category,
+                 event.start, event.duration,
+                 pid, event.tid);
+        trace_first = FALSE;
+
+        trace_dequeue_pos = pos + 1;
+        g_atomic_int_set (&cell->sequence, pos + TRACE_RING_SIZE);
+    }
+
+    gint dropped = g_atomic_int_get (&trace_dropped);
+    if (dropped > 0) {
+        g_atomic_int_add (&trace_dropped, -dropped);
+        fprintf (trace_file,
+                 "%s{\"name\":\"dropped\",\"ph\":\"C\","
+                 "\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,"
+                 "\"args\":{\"events\":%d}}",
+                 trace_first ? "" : ",\n",
+                 g_get_monotonic_time (), pid, dropped);
+        trace_first = FALSE;
+    }
+
+    fflush (trace_file);
+}
+
+gboolean
+Trace::timeoutCallback (gpointer data)
+{
+    flush ();
+    return TRUE;
+}
+
+void
+Trace::init (const gchar *filename)
+{
+    if (filename == NULL)
+        filename = g_getenv ("IBUS_LIBPINYIN_TRACE");
+    if (filename == NULL || *filename == '\0')
+        return;
+
+    trace_file = fopen (filename, "w");
+    if (trace_file == NULL) {
+        g_warning ("can't open trace file %s.\n", filename);
+        return;
+    }
+
+    /* the closing bracket is optional in the JSON array format,
+     * so the file stays readable if the engine is killed. */
+    fputs ("[\n", trace_file);
+
+    trace_cells = g_new0 (TraceCell, TRACE_RING_SIZE);
+    for (guint i = 0; i < TRACE_RING_SIZE; i++)
+        trace_cells[i].sequence = i;
+
+    trace_timeout_id = g_timeout_add_seconds (TRACE_FLUSH_TIMEOUT,
+                                              Trace::timeoutCallback,
+                                              NULL);
+    m_enabled = TRUE;
+}
+
+void
+Trace::finalize (void)
+{
+    if (trace_file == NULL)
+        return;
+
+    m_enabled = FALSE;
+    if (trace_timeout_id != 0) {
+        g_source_remove (trace_timeout_id);
+        trace_timeout_id = 0;
+    }
+
+    flush ();
+    fputs ("\n]\n", trace_file);
+    fclose (trace_file);
+    trace_file = NULL;
+}
+
+};
@@ -0,0 +1,89 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef __PY_TRACE_H_
+#define __PY_TRACE_H_
+
+#include <glib.h>
+
+namespace PY {
+
+/* Optional event tracing in the Chrome trace event format, which
+ * chrome://tracing and Perfetto can open.  Enabled by --trace=FILE or
+ * the IBUS_LIBPINYIN_TRACE environment variable.
+ *
+ * Events are pushed into a fixed size lock-free ring from any thread
+ * and written to the file by a timer on the main loop.  When the ring
+ * is full, events are dropped and counted instead of blocking.
+ *
+ * Names and categories are not copied, use string literals.
+ */
+class Trace {
+public:
+    static void init (const gchar *filename);
+    static void finalize (void);
+
+    static gboolean enabled (void) { return m_enabled; }
+
+    /* a complete event, times from g_get_monotonic_time (). */
+    static void complete (const gchar *name, const gchar *category,
+                          gint64 start, gint64 duration);
+
+    /* write the pending events, called from the main thread. */
+    static void flush (void);
+
+private:
+    static gboolean timeoutCallback (gpointer data);
+
+    static gboolean m_enabled;
+};
+
+/* records the lifetime of the scope as a complete event. */
+class TraceScope {
+public:
+    TraceScope (const gchar *name, const gchar *category)
+        : m_name (name),
+          m_category (category),
+          m_start (G_UNLIKELY (Trace::enabled ()) ? g_get_monotonic_time () : 0)
+    {
+    }
+
+    ~TraceScope (void)
+    {
+        if (G_UNLIKELY (m_start != 0))
+            Trace::complete (m_name, m_category, m_start,
+                             g_get_monotonic_time () - m_start);
+    }
+
+private:
+    const gchar *m_name;
+    const gchar *m_category;
+    gint64 m_start;
+};
+
+#define PY_TRACE_CONCAT_(a, b) a##b
+#define PY_TRACE_CONCAT(a, b) PY_TRACE_CONCAT_ (a, b)
+#define PY_TRACE(name, category) \
+    PY::TraceScope PY_TRACE_CONCAT (_py_trace_, __LINE__) (name, category)
+
+};
+
+#endif
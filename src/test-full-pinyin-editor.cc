@@ -0,0 +1,148 @@
+/* vim:set et ts=4 sts=4:
+ *
+ * ibus-libpinyin - Intelligent Pinyin engine based on libpinyin for IBus
+ *
+ * Copyright (c) 2017 Peng Wu <alexepico@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* Types past MAX_PINYIN_LEN into the full pinyin editor, which with
+ * streaming commits must commit a head of the input to make room, and
+ * without them keeps the full input and drops the key.  The config is
+ * a detached one, so neither ibus nor the user's settings are used. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+#include <ibus.h>
+#include <string>
+#include "PYText.h"
+#include "PYLibPinyin.h"
+#include "PYPConfig.h"
+#include "PYPinyinProperties.h"
+#include "PYPFullPinyinEditor.h"
+
+using namespace PY;
+
+class TestConfig : public LibPinyinConfig {
+public:
+    TestConfig (guint streaming_commit_length)
+        : LibPinyinConfig ("libpinyin")
+    {
+        m_streaming_commit_length = streaming_commit_length;
+    }
+};
+
+class TestEditor {
+public:
+    TestEditor (guint streaming_commit_length)
+        : m_config (streaming_commit_length),
+          m_props (m_config),
+          m_editor (m_props, m_config)
+    {
+        m_editor.signalCommitText ().connect ([this] (Text & text) {
+            m_committed += text.text ();
+        });
+        m_editor.signalUpdatePreeditText ().connect ([] (Text &, guint, gboolean) { });
+        m_editor.signalShowPreeditText ().connect ([] () { });
+        m_editor.signalHidePreeditText ().connect ([] () { });
+        m_editor.signalUpdateAuxiliaryText ().connect ([] (Text &, gboolean) { });
+        m_editor.signalShowAuxiliaryText ().connect ([] () { });
+        m_editor.signalHideAuxiliaryText ().connect ([] () { });
+        m_editor.signalUpdateLookupTable ().connect ([] (LookupTable &, gboolean) { });
+        m_editor.signalUpdateLookupTableFast ().connect ([] (LookupTable &, gboolean) { });
+        m_editor.signalShowLookupTable ().connect ([] () { });
+        m_editor.signalHideLookupTable ().connect ([] () { });
+    }
+
+    TestConfig m_config;
+    PinyinProperties m_props;
+    FullPinyinEditor m_editor;
+    std::string m_committed;
+};
+
+static void
+test_type_past_max_len (const gchar *syllables)
+{
+    TestEditor test (32);
+    FullPinyinEditor & editor = test.m_editor;
+    const std::string & committed = test.m_committed;
+
+    std::string typed;
+    while (typed.length () < MAX_PINYIN_LEN * 2) {
+        for (const gchar *p = syllables; *p; p++) {
+            g_assert (editor.processKeyEvent (*p, 0, 0));
+            typed += *p;
+
+            /* every key is kept, either in the input or committed. */
+            const std::string & text = editor.text ();
+            g_assert (text.length () <= MAX_PINYIN_LEN);
+            g_assert (typed.compare (typed.length () - text.length (),
+                                     text.length (), text) == 0);
+        }
+    }
+
+    /* the input was full at least once, so something was committed. */
+    g_assert (!committed.empty ());
+    g_assert (editor.text ().length () > 0);
+    editor.reset ();
+}
+
+static void
+test_type_past_max_len_no_streaming (const gchar *syllables)
+{
+    TestEditor test (0);
+    FullPinyinEditor & editor = test.m_editor;
+
+    std::string typed;
+    while (typed.length () < MAX_PINYIN_LEN * 2) {
+        for (const gchar *p = syllables; *p; p++) {
+            editor.processKeyEvent (*p, 0, 0);
+            typed += *p;
+        }
+    }
+
+    /* the full input is kept as typed, and the rest is dropped. */
+    const std::string & text = editor.text ();
+    g_assert (text.length () == MAX_PINYIN_LEN);
+    g_assert (typed.compare (0, text.length (), text) == 0);
+    g_assert (test.m_committed.empty ());
+    editor.reset ();
+}
+
+int
+main (gint argc, gchar **argv)
+{
+    /* keep the user dictionary out of the real home. */
+    gchar *home = g_dir_make_tmp ("test-full-pinyin-editor-XXXXXX", NULL);
+    g_assert (home);
+    g_setenv ("XDG_CACHE_HOME", home, TRUE);
+
+    ibus_init ();
+    LibPinyinBackEnd::init ();
+    PinyinConfig::init ();
+
+    /* plain syllables, their head commits at a key boundary. */
+    test_type_past_max_len ("woaizhongguo");
+
+    /* one syllable repeated, which keeps guessing a different head. */
+    test_type_past_max_len ("a");
+
+    /* without streaming commits, nothing is committed on its own. */
+    test_type_past_max_len_no_streaming ("woaizhongguo");
+
+    return 0;
+}